@@ -0,0 +1,106 @@
+#include <queue>
+#include <cmath>
+#include "CompactIndex.h"
+
+static constexpr float QUANT_LEVELS = 65535.0f;
+
+static uint16_t quantize(float value, float min, float extent) {
+    if (extent <= 0.0f) { return 0; }
+    float q = std::round((value - min) / extent * QUANT_LEVELS);
+    return static_cast<uint16_t>(std::min(std::max(q, 0.0f), QUANT_LEVELS));
+}
+
+CompactIndex::CompactIndex(const QuadTree& tree) : storage(tree.getStorage()) {
+    particles.resize(storage.size());
+    nodes.push_back(Node{tree.getRoot()->getBoundary(), 0, 0, 0});
+    flatten(tree.getRoot().get(), 0);
+}
+
+void CompactIndex::flatten(const QuadNode* node, uint32_t index) {
+    if (node->isLeaf()) {
+        const Rect& boundary = node->getBoundary();
+        float xmin = boundary.getPmin().getX().getValue(), ymin = boundary.getPmin().getY().getValue();
+        float width = boundary.getPmax().getX().getValue() - xmin;
+        float height = boundary.getPmax().getY().getValue() - ymin;
+
+        nodes[index].begin = static_cast<uint32_t>(entries.size());
+        nodes[index].count = static_cast<uint32_t>(node->getParticles().size());
+        for (size_t i = 0; i < node->getParticles().size(); ++i) {
+            // La copia del árbol es la que está dentro de la hoja; el handle pudo moverse
+            uint32_t slot = node->getSlots()[i];
+            Point2D position = storage[slot].getPosition();
+            entries.push_back(Entry{quantize(position.getX().getValue(), xmin, width),
+                                    quantize(position.getY().getValue(), ymin, height),
+                                    slot});
+            particles[slot] = node->getParticles()[i];
+        }
+        return;
+    }
+
+    // Los 4 hijos quedan contiguos en el arreglo de nodos
+    uint32_t firstChild = static_cast<uint32_t>(nodes.size());
+    nodes[index].firstChild = firstChild;
+    for (const auto& child : node->getChildren()) {
+        nodes.push_back(Node{child->getBoundary(), 0, 0, 0});
+    }
+    for (uint32_t i = 0; i < 4; ++i) {
+        flatten(node->getChild(i).get(), firstChild + i);
+    }
+}
+
+Rect CompactIndex::entryBounds(const Node& leaf, const Entry& entry) const {
+    float xmin = leaf.boundary.getPmin().getX().getValue(), ymin = leaf.boundary.getPmin().getY().getValue();
+    float stepX = (leaf.boundary.getPmax().getX().getValue() - xmin) / QUANT_LEVELS;
+    float stepY = (leaf.boundary.getPmax().getY().getValue() - ymin) / QUANT_LEVELS;
+
+    // Redondeo conservador: un paso completo a cada lado cubre el error de redondeo en float
+    return Rect(Point2D(xmin + (entry.qx - 1.0f) * stepX, ymin + (entry.qy - 1.0f) * stepY),
+                Point2D(xmin + (entry.qx + 1.0f) * stepX, ymin + (entry.qy + 1.0f) * stepY));
+}
+
+enum class CompactElementKind { Node, Candidate, Exact };
+
+struct CompactKNNElement {
+    float distance;
+    CompactElementKind kind;
+    uint32_t index; // nodo, o slot de partícula
+};
+
+struct CompareCompactKNNElement {
+    bool operator()(const CompactKNNElement& a, const CompactKNNElement& b) const {
+        return a.distance > b.distance;
+    }
+};
+
+std::vector<std::shared_ptr<Particle>> CompactIndex::knn(Point2D query, size_t k) const {
+    std::vector<std::shared_ptr<Particle>> knnParticles;
+    std::priority_queue<CompactKNNElement, std::vector<CompactKNNElement>, CompareCompactKNNElement> pq;
+
+    pq.push({nodes[0].boundary.distance(query).getValue(), CompactElementKind::Node, 0});
+
+    while (!pq.empty() && knnParticles.size() < k) {
+        CompactKNNElement element = pq.top();
+        pq.pop();
+
+        if (element.kind == CompactElementKind::Exact) {
+            knnParticles.push_back(particles[element.index]);
+        } else if (element.kind == CompactElementKind::Candidate) {
+            // La cota inferior llegó al frente: recién ahora se lee la posición exacta
+            float distance = query.distance(storage[element.index].getPosition()).getValue();
+            pq.push({distance, CompactElementKind::Exact, element.index});
+        } else {
+            const Node& node = nodes[element.index];
+            if (node.firstChild == 0) {
+                for (uint32_t i = node.begin; i < node.begin + node.count; ++i) {
+                    pq.push({entryBounds(node, entries[i]).distance(query).getValue(), CompactElementKind::Candidate, entries[i].slot});
+                }
+            } else {
+                for (uint32_t i = node.firstChild; i < node.firstChild + 4; ++i) {
+                    pq.push({nodes[i].boundary.distance(query).getValue(), CompactElementKind::Node, i});
+                }
+            }
+        }
+    }
+
+    return knnParticles;
+}
@@ -0,0 +1,59 @@
+#ifndef COMPACTINDEX_H
+#define COMPACTINDEX_H
+
+#include "QuadTree.h"
+#include <cstdint>
+
+// Índice compacto de solo lectura construido a partir de un QuadTree.
+// Cada entrada de hoja guarda coordenadas de 16 bits cuantizadas respecto del
+// boundary de la hoja y el slot de la partícula en la copia del árbol
+// (QuadTree::getStorage()), 8 bytes en total. Las distancias se acotan con la celda
+// de cuantización y la posición exacta solo se lee, de esa copia, para los
+// candidatos finales. Una tabla slot -> shared_ptr devuelve los resultados.
+//
+// No es un modo del árbol sino un índice adicional: convive con el QuadTree del que
+// lee las posiciones exactas, así que la memoria pico es la del árbol más la del
+// índice. Es válido hasta la siguiente modificación del árbol.
+class CompactIndex {
+public:
+    struct Entry {
+        uint16_t qx, qy;
+        uint32_t slot;
+    };
+
+    struct Node {
+        Rect boundary;
+        uint32_t firstChild; // índice del primero de 4 hijos consecutivos; 0 si es hoja
+        uint32_t begin;      // rango de entradas de la hoja
+        uint32_t count;
+    };
+
+private:
+    std::vector<Node> nodes;
+    std::vector<Entry> entries;
+    const std::vector<Particle>& storage;             // copia del árbol
+    std::vector<std::shared_ptr<Particle>> particles; // slot -> partícula
+
+    void flatten(const QuadNode* node, uint32_t index);
+
+public:
+    explicit CompactIndex(const QuadTree& tree);
+
+    // Celda conservadora en la que cae la posición real de la entrada
+    Rect entryBounds(const Node& leaf, const Entry& entry) const;
+
+    std::vector<std::shared_ptr<Particle>> knn(Point2D query, size_t k) const;
+
+    const std::vector<Node>& getNodes() const { return nodes; }
+    const std::vector<Entry>& getEntries() const { return entries; }
+    const std::shared_ptr<Particle>& getParticle(uint32_t slot) const { return particles[slot]; }
+
+    // Bytes propios del índice: nodos, entradas y la tabla slot -> partícula. No incluye
+    // el árbol del que depende.
+    size_t indexBytes() const {
+        return nodes.size() * sizeof(Node) + entries.size() * sizeof(Entry)
+             + particles.size() * sizeof(std::shared_ptr<Particle>);
+    }
+};
+
+#endif // COMPACTINDEX_H
@@ -0,0 +1,133 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Marca los hilos que ya forman parte de una región paralela para no anidar hilos
+inline thread_local bool insideParallelRegion = false;
+
+inline size_t parallelThreadCount() {
+    if (insideParallelRegion) { return 1; }
+    size_t hardware = std::thread::hardware_concurrency();
+    return hardware > 0 ? hardware : 1;
+}
+
+// Ejecuta body(thread, index) para cada index en [0, n). Los índices se reparten
+// en bloques dinámicos; 'thread' está en [0, parallelThreadCount()) y sirve para
+// indexar salidas locales a cada hilo.
+template <typename Body>
+void parallelFor(size_t n, Body body, size_t grain = 64) {
+    size_t numThreads = std::min(parallelThreadCount(), (n + grain - 1) / grain);
+
+    if (numThreads <= 1) {
+        for (size_t i = 0; i < n; ++i) { body(0, i); }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&](size_t thread) {
+        insideParallelRegion = true;
+        for (size_t begin = next.fetch_add(grain); begin < n; begin = next.fetch_add(grain)) {
+            size_t end = std::min(begin + grain, n);
+            for (size_t i = begin; i < end; ++i) { body(thread, i); }
+        }
+        insideParallelRegion = false;
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < numThreads; ++t) { threads.emplace_back(worker, t); }
+    worker(0);
+    for (auto& thread : threads) { thread.join(); }
+}
+
+// Hilos persistentes para quien reparte trabajo en muchas pasadas cortas (p. ej.
+// el ejecutor del servidor): evita crear y unir hilos en cada parallelFor().
+// Mismo contrato que parallelFor(); lo debe usar un solo hilo a la vez.
+class WorkerPool {
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    std::function<void(size_t, size_t)> task;
+    size_t count = 0, grain = 1, generation = 0, busy = 0;
+    bool stopping = false;
+    std::atomic<size_t> next{0};
+
+    void drain(size_t thread) {
+        for (size_t begin = next.fetch_add(grain); begin < count; begin = next.fetch_add(grain)) {
+            size_t end = std::min(begin + grain, count);
+            for (size_t i = begin; i < end; ++i) { task(thread, i); }
+        }
+    }
+
+    void loop(size_t thread) {
+        insideParallelRegion = true;
+        size_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping) { return; }
+            seen = generation;
+            lock.unlock();
+            drain(thread);
+            lock.lock();
+            if (--busy == 0) { done.notify_one(); }
+        }
+    }
+
+public:
+    explicit WorkerPool(size_t numThreads = parallelThreadCount()) {
+        for (size_t t = 1; t < numThreads; ++t) { workers.emplace_back(&WorkerPool::loop, this, t); }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) { worker.join(); }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t size() const { return workers.size() + 1; }
+
+    template <typename Body>
+    void parallelFor(size_t n, Body body, size_t grain = 64) {
+        if (workers.empty() || n <= grain) {
+            for (size_t i = 0; i < n; ++i) { body(0, i); }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = [&body](size_t thread, size_t i) { body(thread, i); };
+            count = n;
+            this->grain = grain;
+            next = 0;
+            busy = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+
+        // El hilo que llama trabaja como el hilo 0
+        bool nested = insideParallelRegion;
+        insideParallelRegion = true;
+        drain(0);
+        insideParallelRegion = nested;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]() { return busy == 0; });
+        task = nullptr;
+    }
+};
+
+#endif // PARALLEL_H
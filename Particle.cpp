@@ -2,7 +2,11 @@
 const NType Particle::timeStep = 1.5;
 
 void Particle::updatePosition(const Rect& boundary) {
-    NType remainingTime = timeStep;
+    updatePosition(boundary, timeStep);
+}
+
+void Particle::updatePosition(const Rect& boundary, NType dt) {
+    NType remainingTime = dt;
     
     while (remainingTime > 0) {
         Point2D newPosition = position + (velocity * remainingTime);
@@ -42,4 +46,33 @@ void Particle::updatePosition(const Rect& boundary) {
             break;
         }
     }
+}
+
+static NType cross(const Point2D& o, const Point2D& a, const Point2D& b) {
+    return (a.getX() - o.getX()) * (b.getY() - o.getY()) - (a.getY() - o.getY()) * (b.getX() - o.getX());
+}
+
+static NType pointSegmentDistance(const Point2D& p, const Point2D& a, const Point2D& b) {
+    Point2D ab = b - a;
+    NType lengthSq = ab.getX() * ab.getX() + ab.getY() * ab.getY();
+    if (lengthSq == 0) { return p.distance(a); }
+
+    NType t = ((p.getX() - a.getX()) * ab.getX() + (p.getY() - a.getY()) * ab.getY()) / lengthSq;
+    t = max(NType(0), min(NType(1), t));
+    return p.distance(a + ab * t);
+}
+
+static NType segmentDistance(const Point2D& a, const Point2D& b, const Point2D& c, const Point2D& d) {
+    NType d1 = cross(a, b, c), d2 = cross(a, b, d);
+    NType d3 = cross(c, d, a), d4 = cross(c, d, b);
+    if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) {
+        return 0;
+    }
+
+    return min(min(pointSegmentDistance(a, c, d), pointSegmentDistance(b, c, d)),
+               min(pointSegmentDistance(c, a, b), pointSegmentDistance(d, a, b)));
+}
+
+NType Particle::sweepDistance(const Particle& other) const {
+    return segmentDistance(position, getSweepEnd(), other.position, other.getSweepEnd());
 }
\ No newline at end of file
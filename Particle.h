@@ -16,11 +16,19 @@ public:
 
     Point2D getPosition() const { return position; }
     Point2D getVelocity() const { return velocity; }
+    static NType getTimeStep() { return timeStep; }
+
+    // Recorrido en línea recta del próximo paso (sin considerar rebotes)
+    Point2D getSweepEnd() const { return position + velocity * timeStep; }
 
     void setPosition(const Point2D& pos) { position = pos; }
     void setVelocity(const Point2D& vel) { velocity = vel; }
 
     void updatePosition(const Rect& boundary);
+    void updatePosition(const Rect& boundary, NType dt);
+
+    // Distancia mínima entre los recorridos del próximo paso de ambas partículas
+    NType sweepDistance(const Particle& other) const;
 };
 
 
@@ -1,24 +1,39 @@
 #include <variant>
 #include <queue>
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
+#include <functional>
 #include "QuadTree.h"
+#include "Parallel.h"
 
 size_t Counter::superCounter = 0;
+size_t QuadTree::bucketSize = 6;
+size_t QuadTree::maxDepth = 24;
+NType QuadTree::minCellSize = 0;
+
+static NType sweepLength(const Particle& particle) {
+    return Point2D().distance(particle.getVelocity()) * Particle::getTimeStep();
+}
+
 // QuadNode
-void QuadNode::addToBucket(const std::shared_ptr<Particle>& particle) {
+void QuadNode::addToBucket(const std::shared_ptr<Particle>& particle, uint32_t slot) {
     particles.push_back(particle);
+    slots.push_back(slot);
 }
 
-bool QuadNode::propagate(const std::shared_ptr<Particle>& particle) {
+bool QuadNode::propagate(const std::shared_ptr<Particle>& particle, uint32_t slot) {
     if (_isLeaf && boundary.contains(particle->getPosition()))
     {
-        return insert(particle); 
+        return insert(particle, slot); 
     }
 
     if (boundary.contains(particle->getPosition()))
     {
+        maxSweep = max(maxSweep, sweepLength(*particle));
         for (const auto& child : children) {
             if (child && child->getBoundary().contains(particle->getPosition())) {
-                return child->propagate(particle);
+                return child->propagate(particle, slot);
             }
         }
     }
@@ -34,18 +49,40 @@ void QuadNode::subdivide() {
     children[1] = std::make_unique<QuadNode>(centerP.getX(), centerP.getY(), Pmax.getX(), Pmax.getY(), this); // NE
     children[2] = std::make_unique<QuadNode>(Pmin.getX(), Pmin.getY(), centerP.getX(), centerP.getY(), this); // SW
     children[3] = std::make_unique<QuadNode>(centerP.getX(), Pmin.getY(), Pmax.getX(), centerP.getY(), this); // SE
+    for (const auto& child : children) {
+        child->capacity = capacity;
+        child->mergeThreshold = mergeThreshold;
+    }
     _isLeaf = false;
 }
 
-void QuadNode::relocateParticle(const std::shared_ptr<Particle>& particle) {
+void QuadNode::split() {
+    subdivide();
+    for (size_t i = 0; i < particles.size(); ++i) {
+        // Una partícula que aún no se actualizó puede estar ya fuera de la raíz:
+        // se conserva en el cuadrante más cercano hasta que su hoja la reubique.
+        const auto& p = particles[i];
+        if (!relocateParticle(p, slots[i])) { children[quadrantOf(p->getPosition())]->addToBucket(p, slots[i]); }
+    }
+    particles.clear();
+    slots.clear();
+}
+
+size_t QuadNode::quadrantOf(const Point2D& point) const {
+    Point2D centerP = boundary.getCenter();
+    bool east = point.getX() >= centerP.getX();
+    bool north = point.getY() >= centerP.getY();
+    return (north ? 0 : 2) + (east ? 1 : 0);
+}
+
+bool QuadNode::relocateParticle(const std::shared_ptr<Particle>& particle, uint32_t slot) {
     if (!boundary.contains(particle->getPosition()))
     {
-        if (parent) { parent->relocateParticle(particle); }
-        return;
+        if (parent) { return parent->relocateParticle(particle, slot); }
+        return false;
     }
 
-    propagate(particle);
-    return;
+    return propagate(particle, slot);
 }
 
 void QuadNode::removeEmptyNode() {
@@ -54,9 +91,11 @@ void QuadNode::removeEmptyNode() {
     size_t numParticles = 0;
     int nonEmptyChildCount = 0;
     QuadNode* nonEmptyChild = nullptr;
+    bool allChildrenLeaves = true;
 
     for (const auto& child: children) {
         if (child) {
+            allChildrenLeaves = allChildrenLeaves && child->_isLeaf;
             if (!child->_isLeaf || !child->particles.empty()) {
                 nonEmptyChildCount++;
                 numParticles += child->particles.size();
@@ -77,7 +116,21 @@ void QuadNode::removeEmptyNode() {
     if (numParticles > 0 && nonEmptyChildCount == 1)
     {
         particles = std::move(nonEmptyChild->particles);
+        slots = std::move(nonEmptyChild->slots);
+        for (auto& child : children) {
+            child.reset();
+        }
+        _isLeaf = true;
+        return;
+    }
+
+    // Histéresis del modo adaptativo: los hermanos se fusionan recién al bajar de
+    // mergeThreshold, bastante por debajo de la capacidad que provocó la división.
+    if (allChildrenLeaves && numParticles <= mergeThreshold)
+    {
         for (auto& child : children) {
+            particles.insert(particles.end(), child->particles.begin(), child->particles.end());
+            slots.insert(slots.end(), child->slots.begin(), child->slots.end());
             child.reset();
         }
         _isLeaf = true;
@@ -87,63 +140,206 @@ void QuadNode::removeEmptyNode() {
 }
 
 
-bool QuadNode::insert(const std::shared_ptr<Particle>& particle) {
+bool QuadNode::insert(const std::shared_ptr<Particle>& particle, uint32_t slot) {
     if (!boundary.contains(particle->getPosition())) { return false; }
 
-    if (_isLeaf && particles.size() < QuadTree::bucketSize)
+    maxSweep = max(maxSweep, sweepLength(*particle));
+
+    if (_isLeaf && (particles.size() < getCapacity() || !canSubdivide() || coincidesWith(particle->getPosition())))
     {
-        addToBucket(particle);
+        addToBucket(particle, slot);
         return true;
     }
 
     if (_isLeaf) {
-        subdivide();
-        for (const auto& p: particles) { relocateParticle(p); }
-        particles.clear();
+        split();
     }
     
-    return propagate(particle);
+    return propagate(particle, slot);
 }
 
-void QuadNode::updateNode() {
+size_t QuadNode::updateNode(std::vector<std::pair<std::shared_ptr<Particle>, uint32_t>>& outOfBounds) {
+    dirty = false;
+
     if (!_isLeaf) {
+        size_t moved = 0;
         for (const auto& child: children)
         {
-            child->updateNode();
+            moved += child->updateNode(outOfBounds);
         }
         removeEmptyNode();
-        return;
+        refreshSweep();
+        return moved;
     }
 
-    std::vector<std::shared_ptr<Particle>> particlesToRelocate;
+    std::vector<std::pair<std::shared_ptr<Particle>, uint32_t>> particlesToRelocate;
+    size_t kept = 0;
 
-    for (auto it = particles.begin(); it != particles.end(); ) {
-        if (!boundary.contains((*it)->getPosition())) {
-            particlesToRelocate.push_back(*it);
-            it = particles.erase(it);
+    for (size_t i = 0; i < particles.size(); ++i) {
+        if (!boundary.contains(particles[i]->getPosition())) {
+            particlesToRelocate.emplace_back(std::move(particles[i]), slots[i]);
         } else {
-            ++it;
+            if (kept != i) {
+                particles[kept] = std::move(particles[i]);
+                slots[kept] = slots[i];
+            }
+            kept++;
         }
     }
+    particles.resize(kept);
+    slots.resize(kept);
+    churn += particlesToRelocate.size();
+
+    // Un bucket de duplicados cuyas partículas se separaron vuelve a dividirse
+    if (particles.size() > getCapacity() && canSubdivide() && !isCoincident()) { split(); }
 
-    for (const auto& p : particlesToRelocate) {
-        relocateParticle(p);
+    refreshSweep();
+
+    for (const auto& [p, slot] : particlesToRelocate) {
+        if (!relocateParticle(p, slot)) { outOfBounds.emplace_back(p, slot); }
     }
 
-    return;
+    return particlesToRelocate.size();
+}
+
+void QuadNode::refreshSweep() {
+    maxSweep = 0;
+    if (_isLeaf) {
+        for (const auto& particle : particles) { maxSweep = max(maxSweep, sweepLength(*particle)); }
+    } else {
+        for (const auto& child : children) { maxSweep = max(maxSweep, child->maxSweep); }
+    }
+}
+
+void QuadNode::raiseSweep(NType sweep) {
+    for (QuadNode* node = parent; node && node->maxSweep < sweep; node = node->parent) {
+        node->maxSweep = sweep;
+    }
+}
+
+bool QuadNode::coincidesWith(const Point2D& position) const {
+    if (particles.empty() || !(particles.front()->getPosition() == position)) { return false; }
+
+    // Un bucket que ya desbordó por duplicados solo contiene puntos iguales al primero
+    if (particles.size() > getCapacity()) { return true; }
+    return isCoincident();
+}
+
+bool QuadNode::isCoincident() const {
+    for (const auto& particle : particles) {
+        if (!(particle->getPosition() == particles.front()->getPosition())) { return false; }
+    }
+    return true;
+}
+
+size_t QuadNode::getCapacity() const {
+    return capacity > 0 ? capacity : QuadTree::bucketSize;
+}
+
+bool QuadNode::canSubdivide() const {
+    NType halfWidth = (boundary.getPmax().getX() - boundary.getPmin().getX()) * 0.5f;
+    NType halfHeight = (boundary.getPmax().getY() - boundary.getPmin().getY()) * 0.5f;
+
+    // Celdas por debajo del epsilon de Safe ya no separan puntos distintos
+    if (halfWidth <= 0 || halfHeight <= 0) { return false; }
+    if (halfWidth < QuadTree::minCellSize || halfHeight < QuadTree::minCellSize) { return false; }
+    return depth < static_cast<int>(QuadTree::maxDepth);
 }
 
+bool QuadNode::erase(const Point2D& position, uint32_t slot) {
+    // Un punto sobre un borde compartido puede estar en más de un hijo
+    if (!boundary.contains(position)) { return false; }
+
+    if (_isLeaf) {
+        auto it = std::find(slots.begin(), slots.end(), slot);
+        if (it == slots.end()) { return false; }
+
+        particles.erase(particles.begin() + (it - slots.begin()));
+        slots.erase(it);
+        churn++;
+        markDirty();
+        return true;
+    }
+
+    for (const auto& child : children) {
+        if (child && child->erase(position, slot)) { return true; }
+    }
+    return false;
+}
+
+void QuadNode::markDirty() {
+    for (QuadNode* node = this; node && !node->dirty; node = node->parent) {
+        node->dirty = true;
+    }
+}
+
+void QuadNode::collapseDirty() {
+    if (!dirty) { return; }
+    dirty = false;
+
+    if (!_isLeaf) {
+        for (const auto& child : children) {
+            child->collapseDirty();
+        }
+        removeEmptyNode();
+    }
+    refreshSweep();
+}
+
+std::shared_ptr<const VersionNode> QuadNode::snapshot() {
+    // Path copying: solo se crea un VersionNode nuevo si el contenido difiere del
+    // guardado; un nodo interno se reutiliza si todos sus hijos se reutilizaron.
+    if (_isLeaf) {
+        bool unchanged = version && version->isLeaf() && version->entries.size() == particles.size();
+        for (size_t i = 0; unchanged && i < particles.size(); ++i) {
+            const VersionEntry& entry = version->entries[i];
+            Point2D position = particles[i]->getPosition();
+            unchanged = entry.particle == particles[i] &&
+                entry.position.getX().getValue() == position.getX().getValue() &&
+                entry.position.getY().getValue() == position.getY().getValue();
+        }
+        if (unchanged) { return version; }
+
+        auto node = std::make_shared<VersionNode>();
+        node->boundary = boundary;
+        node->entries.reserve(particles.size());
+        for (const auto& particle : particles) { node->entries.push_back({particle, particle->getPosition()}); }
+        version = std::move(node);
+        return version;
+    }
+
+    std::array<std::shared_ptr<const VersionNode>, 4> snapshots;
+    bool unchanged = version && !version->isLeaf();
+    for (size_t i = 0; i < children.size(); ++i) {
+        snapshots[i] = children[i]->snapshot();
+        unchanged = unchanged && snapshots[i] == version->children[i];
+    }
+    if (unchanged) { return version; }
+
+    auto node = std::make_shared<VersionNode>();
+    node->boundary = boundary;
+    node->children = std::move(snapshots);
+    version = std::move(node);
+    return version;
+}
+
+// Partícula candidata: handle del bucket y posición leída de la copia del árbol
+struct KNNParticle {
+    const std::shared_ptr<Particle>* handle;
+    Point2D position;
+};
+
 struct KNNElement {
-    std::variant<QuadNode*, std::shared_ptr<Particle>> element;
+    std::variant<QuadNode*, KNNParticle> element;
 
     KNNElement(QuadNode* node) : element(node) {}
-    KNNElement(std::shared_ptr<Particle> particle) : element(particle) {}
+    KNNElement(const std::shared_ptr<Particle>& particle, const Point2D& position) : element(KNNParticle{&particle, position}) {}
     
     bool isNode() const { return std::holds_alternative<QuadNode*>(element); }
 
     NType distance(Point2D& query) const {
         if (isNode()) { return std::get<QuadNode*>(element)->getBoundary().distance(query); }
-        else { return query.distance(std::get<std::shared_ptr<Particle>>(element)->getPosition()); }
+        else { return query.distance(std::get<KNNParticle>(element).position); }
     }
 };
 
@@ -152,7 +348,8 @@ struct CompareKNNElement {
     CompareKNNElement(Point2D query): query(query) {}
 
     bool operator()(const KNNElement& element1, const KNNElement& element2){
-        return element1.distance(query) > element2.distance(query);
+        // Comparación exacta: el epsilon de Safe no da un orden estricto débil para el heap
+        return element1.distance(query).getValue() > element2.distance(query).getValue();
     }
 };
 
@@ -170,8 +367,29 @@ std::vector<std::shared_ptr<Particle>> QuadTree::knn(Point2D query, size_t k) {
         if (element.isNode()) {
             QuadNode* node = std::get<QuadNode*>(element.element);
             if (node->isLeaf()) {
-                for (auto& particle : node->getParticles()) {
-                    pq.push(KNNElement(particle));
+                const auto& bucket = node->getParticles();
+                const auto& slots = node->slots;
+                size_t remaining = k - knnParticles.size();
+                countScans(node, bucket.size());
+                if (bucket.size() <= remaining) {
+                    for (size_t i = 0; i < bucket.size(); ++i) {
+                        pq.push(KNNElement(bucket[i], storage[slots[i]].getPosition()));
+                    }
+                } else {
+                    // Un bucket de desbordamiento solo puede aportar sus 'remaining' partículas más cercanas
+                    std::vector<std::pair<NType, size_t>> nearest;
+                    nearest.reserve(bucket.size());
+                    for (size_t i = 0; i < bucket.size(); ++i) {
+                        nearest.emplace_back(query.distance(storage[slots[i]].getPosition()), i);
+                    }
+                    std::nth_element(nearest.begin(), nearest.begin() + remaining, nearest.end(),
+                        [](const std::pair<NType, size_t>& a, const std::pair<NType, size_t>& b) {
+                            return a.first.getValue() < b.first.getValue();
+                        });
+                    for (size_t i = 0; i < remaining; ++i) {
+                        size_t index = nearest[i].second;
+                        pq.push(KNNElement(bucket[index], storage[slots[index]].getPosition()));
+                    }
                 }
             } else {
                 for (auto& child : node->getChildren()) {
@@ -179,10 +397,592 @@ std::vector<std::shared_ptr<Particle>> QuadTree::knn(Point2D query, size_t k) {
                 }
             }
         } else {
-            std::shared_ptr<Particle> particle = std::get<std::shared_ptr<Particle>>(element.element);
-            knnParticles.push_back(particle);
+            knnParticles.push_back(*std::get<KNNParticle>(element.element).handle);
         }
     }
 
     return knnParticles;
-}
\ No newline at end of file
+}
+
+// k-NN graph
+static float squaredRectDistance(const Rect& a, const Rect& b) {
+    float dx = std::max({0.0f, a.getPmin().getX().getValue() - b.getPmax().getX().getValue(),
+                         b.getPmin().getX().getValue() - a.getPmax().getX().getValue()});
+    float dy = std::max({0.0f, a.getPmin().getY().getValue() - b.getPmax().getY().getValue(),
+                         b.getPmin().getY().getValue() - a.getPmax().getY().getValue()});
+    return dx * dx + dy * dy;
+}
+
+static float squaredDistance(const Point2D& a, const Point2D& b) {
+    float dx = a.getX().getValue() - b.getX().getValue();
+    float dy = a.getY().getValue() - b.getY().getValue();
+    return dx * dx + dy * dy;
+}
+
+KnnGraph QuadTree::knnGraph(size_t k) const {
+    std::vector<QuadNode*> leaves;
+    collectLeaves(root.get(), leaves);
+
+    KnnGraph graph;
+    std::unordered_map<const QuadNode*, uint32_t> firstId;
+    for (const auto& leaf : leaves) {
+        firstId[leaf] = static_cast<uint32_t>(graph.particles.size());
+        graph.particles.insert(graph.particles.end(), leaf->particles.begin(), leaf->particles.end());
+    }
+
+    size_t n = graph.particles.size();
+    size_t degree = n > 0 ? std::min(k, n - 1) : 0;
+    graph.offsets.resize(n + 1);
+    for (size_t i = 0; i <= n; ++i) { graph.offsets[i] = i * degree; }
+    graph.neighbors.resize(n * degree);
+    if (degree == 0) { return graph; }
+
+    using Candidate = std::pair<float, uint32_t>;   // distancia al cuadrado, id
+    using NodeEntry = std::pair<float, const QuadNode*>;
+
+    parallelFor(leaves.size(), [&](size_t, size_t l) {
+        const QuadNode* leaf = leaves[l];
+        size_t m = leaf->particles.size();
+        if (m == 0) { return; }
+        uint32_t base = firstId.at(leaf);
+
+        std::vector<Point2D> positions(m);
+        for (size_t i = 0; i < m; ++i) { positions[i] = storage[leaf->slots[i]].getPosition(); }
+        std::vector<std::vector<Candidate>> heaps(m); // max-heaps de tamaño degree
+
+        // Búsqueda por distancia al Rect de la hoja: es cota inferior para todas sus partículas
+        std::priority_queue<NodeEntry, std::vector<NodeEntry>, std::greater<NodeEntry>> pq;
+        pq.push({squaredRectDistance(leaf->boundary, root->boundary), root.get()});
+        float bound = std::numeric_limits<float>::infinity();
+
+        // La propia hoja se recorre primero: en un bucket de duplicados llena los heaps
+        // con distancias 0 antes de examinar hojas vecinas también a distancia 0.
+        bool first = true;
+        while (first || (!pq.empty() && pq.top().first <= bound)) {
+            const QuadNode* node = leaf;
+            if (!first) {
+                node = pq.top().second;
+                pq.pop();
+                if (node == leaf) { continue; }
+            }
+            first = false;
+
+            if (!node->isLeaf()) {
+                for (const auto& child : node->children) {
+                    pq.push({squaredRectDistance(leaf->boundary, child->boundary), child.get()});
+                }
+                continue;
+            }
+
+            uint32_t candidateBase = firstId.at(node);
+            countScans(node, node->particles.size());
+            for (size_t i = 0; i < m; ++i) {
+                auto& heap = heaps[i];
+                for (size_t j = 0; j < node->particles.size(); ++j) {
+                    // Con k vecinos a distancia 0 ya no hay mejora posible (buckets de duplicados)
+                    if (heap.size() == degree && heap.front().first == 0.0f) { break; }
+                    uint32_t id = candidateBase + static_cast<uint32_t>(j);
+                    if (id == base + i) { continue; }
+                    float distance = squaredDistance(positions[i], storage[node->slots[j]].getPosition());
+                    if (heap.size() < degree) {
+                        heap.emplace_back(distance, id);
+                        std::push_heap(heap.begin(), heap.end());
+                    } else if (distance < heap.front().first) {
+                        std::pop_heap(heap.begin(), heap.end());
+                        heap.back() = {distance, id};
+                        std::push_heap(heap.begin(), heap.end());
+                    }
+                }
+            }
+
+            // Se puede cortar cuando el siguiente nodo está más lejos que el k-ésimo vecino de todas
+            bound = 0;
+            for (const auto& heap : heaps) {
+                if (heap.size() < degree) { bound = std::numeric_limits<float>::infinity(); break; }
+                bound = std::max(bound, heap.front().first);
+            }
+        }
+
+        for (size_t i = 0; i < m; ++i) {
+            std::sort_heap(heaps[i].begin(), heaps[i].end());
+            uint32_t* row = graph.neighbors.data() + graph.offsets[base + i];
+            for (size_t j = 0; j < degree; ++j) { row[j] = heaps[i][j].second; }
+        }
+    }, 4);
+
+    return graph;
+}
+
+// Range query
+void QuadTree::rangeQuery(const QuadNode* node, const Rect& range, std::vector<std::shared_ptr<Particle>>& result) const {
+    // Intersección cerrada: una partícula en el borde del nodo puede estar en el borde del rango
+    const Rect& bounds = node->getBoundary();
+    if (bounds.getPmax().getX() < range.getPmin().getX() || bounds.getPmin().getX() > range.getPmax().getX() ||
+        bounds.getPmax().getY() < range.getPmin().getY() || bounds.getPmin().getY() > range.getPmax().getY()) {
+        return;
+    }
+
+    if (node->isLeaf()) {
+        countScans(node, node->particles.size());
+        for (size_t i = 0; i < node->particles.size(); ++i) {
+            if (range.contains(storage[node->slots[i]].getPosition())) { result.push_back(node->particles[i]); }
+        }
+        return;
+    }
+
+    for (const auto& child : node->children) {
+        if (child) { rangeQuery(child.get(), range, result); }
+    }
+}
+
+std::vector<std::shared_ptr<Particle>> QuadTree::rangeQuery(const Rect& range) const {
+    std::vector<std::shared_ptr<Particle>> result;
+    rangeQuery(root.get(), range, result);
+    return result;
+}
+
+// Swept query
+void QuadTree::sweptQuery(const QuadNode* node, const std::shared_ptr<Particle>& handle, const Particle& particle, const Rect& sweep, NType radius,
+                          std::vector<std::shared_ptr<Particle>>& result) const {
+    // El Rect del nodo se expande por el radio y por el mayor recorrido de su subárbol
+    NType reach = radius + node->maxSweep;
+    const Rect& bounds = node->getBoundary();
+    if (sweep.getPmin().getX() > bounds.getPmax().getX() + reach || sweep.getPmax().getX() < bounds.getPmin().getX() - reach ||
+        sweep.getPmin().getY() > bounds.getPmax().getY() + reach || sweep.getPmax().getY() < bounds.getPmin().getY() - reach) {
+        return;
+    }
+
+    if (node->isLeaf()) {
+        countScans(node, node->particles.size());
+        for (size_t i = 0; i < node->particles.size(); ++i) {
+            if (node->particles[i] == handle) { continue; }
+            if (particle.sweepDistance(storage[node->slots[i]]) <= radius) {
+                result.push_back(node->particles[i]);
+            }
+        }
+        return;
+    }
+
+    for (const auto& child : node->children) {
+        if (child) { sweptQuery(child.get(), handle, particle, sweep, radius, result); }
+    }
+}
+
+std::vector<std::shared_ptr<Particle>> QuadTree::sweptQuery(const std::shared_ptr<Particle>& particle, NType radius) const {
+    Point2D start = particle->getPosition();
+    Point2D end = particle->getSweepEnd();
+    Rect sweep(Point2D(min(start.getX(), end.getX()), min(start.getY(), end.getY())),
+               Point2D(max(start.getX(), end.getX()), max(start.getY(), end.getY())));
+
+    std::vector<std::shared_ptr<Particle>> result;
+    sweptQuery(root.get(), particle, *particle, sweep, radius, result);
+    return result;
+}
+
+// Swept collisions: recorrido doble del árbol sobre pares de nodos
+using NodePair = std::pair<const QuadNode*, const QuadNode*>;
+
+static float axisGap(float minA, float maxA, float minB, float maxB) {
+    return std::max({0.0f, minB - maxA, minA - maxB});
+}
+
+// Los recorridos de un nodo no salen de su Rect expandido por maxSweep
+static bool sweepsMayMeet(const QuadNode* a, const QuadNode* b, float radius) {
+    if (a == b) { return true; }
+    float reach = radius + a->getMaxSweep().getValue() + b->getMaxSweep().getValue();
+    const Rect& ra = a->getBoundary();
+    const Rect& rb = b->getBoundary();
+    return axisGap(ra.getPmin().getX().getValue(), ra.getPmax().getX().getValue(), rb.getPmin().getX().getValue(), rb.getPmax().getX().getValue()) <= reach &&
+           axisGap(ra.getPmin().getY().getValue(), ra.getPmax().getY().getValue(), rb.getPmin().getY().getValue(), rb.getPmax().getY().getValue()) <= reach;
+}
+
+// Subpares de (a, b) que pueden contener colisiones. El par (a, a) se divide en los
+// pares de hijos (i, j) con i <= j, así cada par de hojas aparece una sola vez.
+static void splitPair(const NodePair& pair, float radius, std::vector<NodePair>& out) {
+    const auto [a, b] = pair;
+    if (a == b) {
+        for (size_t i = 0; i < 4; ++i) {
+            for (size_t j = i; j < 4; ++j) {
+                const QuadNode* ci = a->getChild(i).get();
+                const QuadNode* cj = a->getChild(j).get();
+                if (sweepsMayMeet(ci, cj, radius)) { out.emplace_back(ci, cj); }
+            }
+        }
+        return;
+    }
+
+    // Se divide el nodo interno más grande
+    float widthA = (a->getBoundary().getPmax().getX() - a->getBoundary().getPmin().getX()).getValue();
+    float widthB = (b->getBoundary().getPmax().getX() - b->getBoundary().getPmin().getX()).getValue();
+    bool splitA = !a->isLeaf() && (b->isLeaf() || widthA >= widthB);
+    const QuadNode* parent = splitA ? a : b;
+    for (const auto& child : parent->getChildren()) {
+        NodePair sub = splitA ? NodePair(child.get(), b) : NodePair(a, child.get());
+        if (sweepsMayMeet(sub.first, sub.second, radius)) { out.push_back(sub); }
+    }
+}
+
+std::vector<std::pair<std::shared_ptr<Particle>, std::shared_ptr<Particle>>> QuadTree::sweptCollisions(NType radius) const {
+    float r = radius.getValue();
+    using Collision = std::pair<std::shared_ptr<Particle>, std::shared_ptr<Particle>>;
+
+    // Caja del recorrido de cada partícula, para descartar pares antes de sweepDistance()
+    auto sweepBox = [&](uint32_t slot) {
+        Point2D start = storage[slot].getPosition();
+        Point2D end = storage[slot].getSweepEnd();
+        return std::array<float, 4>{std::min(start.getX().getValue(), end.getX().getValue()), std::max(start.getX().getValue(), end.getX().getValue()),
+                                    std::min(start.getY().getValue(), end.getY().getValue()), std::max(start.getY().getValue(), end.getY().getValue())};
+    };
+
+    auto collideLeaves = [&](const QuadNode* a, const QuadNode* b, std::vector<Collision>& out) {
+        countScans(a, a->particles.size());
+        if (a != b) { countScans(b, b->particles.size()); }
+        for (size_t i = 0; i < a->particles.size(); ++i) {
+            const Particle& particle = storage[a->slots[i]];
+            auto boxA = sweepBox(a->slots[i]);
+            for (size_t j = (a == b ? i + 1 : 0); j < b->particles.size(); ++j) {
+                auto boxB = sweepBox(b->slots[j]);
+                if (axisGap(boxA[0], boxA[1], boxB[0], boxB[1]) > r || axisGap(boxA[2], boxA[3], boxB[2], boxB[3]) > r) { continue; }
+                if (particle.sweepDistance(storage[b->slots[j]]) <= radius) {
+                    const auto& first = a->particles[i];
+                    const auto& second = b->particles[j];
+                    if (first.get() < second.get()) { out.emplace_back(first, second); }
+                    else { out.emplace_back(second, first); }
+                }
+            }
+        }
+    };
+
+    // Los pares de nodos de los primeros niveles se reparten entre los hilos
+    std::vector<NodePair> tasks = {NodePair(root.get(), root.get())};
+    size_t targetTasks = 64 * parallelThreadCount();
+    while (tasks.size() < targetTasks) {
+        std::vector<NodePair> next;
+        bool split = false;
+        for (const auto& pair : tasks) {
+            if (pair.first->isLeaf() && pair.second->isLeaf()) { next.push_back(pair); }
+            else { splitPair(pair, r, next); split = true; }
+        }
+        tasks.swap(next);
+        if (!split) { break; }
+    }
+
+    std::vector<std::vector<Collision>> local(parallelThreadCount());
+    parallelFor(tasks.size(), [&](size_t thread, size_t t) {
+        std::vector<NodePair> stack = {tasks[t]};
+        while (!stack.empty()) {
+            NodePair pair = stack.back();
+            stack.pop_back();
+            if (pair.first->isLeaf() && pair.second->isLeaf()) { collideLeaves(pair.first, pair.second, local[thread]); }
+            else { splitPair(pair, r, stack); }
+        }
+    }, 1);
+
+    std::vector<Collision> collisions;
+    for (auto& pairs : local) {
+        collisions.insert(collisions.end(), pairs.begin(), pairs.end());
+    }
+    return collisions;
+}
+
+// QuadTree
+uint32_t QuadTree::allocateSlot(const std::shared_ptr<Particle>& particle) {
+    indexed++;
+    displaced++;
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+        storage[slot] = *particle;
+    } else {
+        storage.push_back(*particle);
+        slot = static_cast<uint32_t>(storage.size() - 1);
+    }
+    slotOf[particle.get()] = slot;
+    return slot;
+}
+
+void QuadTree::syncStorage() {
+    std::vector<QuadNode*> leaves;
+    collectLeaves(root.get(), leaves);
+    parallelFor(leaves.size(), [&](size_t, size_t i) {
+        const QuadNode* leaf = leaves[i];
+        for (size_t j = 0; j < leaf->particles.size(); ++j) { storage[leaf->slots[j]] = *leaf->particles[j]; }
+    }, 16);
+}
+
+void QuadTree::releaseSlot(const std::shared_ptr<Particle>& particle, uint32_t slot) {
+    indexed--;
+    freeSlots.push_back(slot);
+    slotOf.erase(particle.get());
+}
+
+bool QuadTree::insert(const std::shared_ptr<Particle>& particle) {
+    return insert(particle, allocateSlot(particle));
+}
+
+bool QuadTree::insert(const std::shared_ptr<Particle>& particle, uint32_t slot) {
+    if (root->insert(particle, slot)) { return true; }
+
+    Point2D position = particle->getPosition();
+    if (!autoGrow || !std::isfinite(position.getX().getValue()) || !std::isfinite(position.getY().getValue())) {
+        releaseSlot(particle, slot);
+        outOfBounds.push_back(particle);
+        return false;
+    }
+
+    while (!root->getBoundary().contains(position)) {
+        growRoot(position);
+    }
+    return root->insert(particle, slot);
+}
+
+void QuadTree::step(const Rect& boundary, NType dt) {
+    std::vector<QuadNode*> leaves;
+    collectLeaves(root.get(), leaves);
+
+    struct Escaped {
+        QuadNode* leaf;
+        std::shared_ptr<Particle> particle;
+        uint32_t slot;
+    };
+    std::vector<std::vector<Escaped>> escaped(parallelThreadCount());
+    std::vector<std::vector<QuadNode*>> oversized(parallelThreadCount());
+    std::vector<std::vector<std::pair<QuadNode*, NType>>> grown(parallelThreadCount());
+    parallelFor(leaves.size(), [&](size_t thread, size_t i) {
+        QuadNode* leaf = leaves[i];
+        auto& bucket = leaf->particles;
+        auto& slots = leaf->slots;
+        NType sweep = 0, escapedSweep = 0;
+        size_t kept = 0;
+
+        for (size_t j = 0; j < bucket.size(); ++j) {
+            Particle& state = storage[slots[j]];
+            bucket[j]->updatePosition(boundary, dt);
+            state = *bucket[j];
+            if (leaf->boundary.contains(state.getPosition())) {
+                sweep = max(sweep, sweepLength(state));
+                if (kept != j) {
+                    bucket[kept] = std::move(bucket[j]);
+                    slots[kept] = slots[j];
+                }
+                kept++;
+            } else {
+                escapedSweep = max(escapedSweep, sweepLength(state));
+                escaped[thread].push_back({leaf, std::move(bucket[j]), slots[j]});
+            }
+        }
+        leaf->churn += bucket.size() - kept;
+        bucket.resize(kept);
+        slots.resize(kept);
+        leaf->maxSweep = sweep;
+
+        // Los ancestros solo se escriben fuera de la pasada paralela
+        NType reach = max(sweep, escapedSweep);
+        if (leaf->parent && leaf->parent->maxSweep < reach) { grown[thread].emplace_back(leaf, reach); }
+
+        if (kept > leaf->getCapacity() && leaf->canSubdivide() && !leaf->isCoincident()) { oversized[thread].push_back(leaf); }
+    }, 16);
+
+    // Una velocidad que creció deja cortas las cotas de los ancestros, aunque la partícula
+    // no cambie de hoja. Las que salieron se cubren también: la reubicación solo eleva
+    // la cota desde el ancestro común hacia abajo.
+    for (const auto& batch : grown) {
+        for (const auto& [leaf, reach] : batch) { leaf->raiseSweep(reach); }
+    }
+
+    // Buckets de duplicados cuyas partículas se separaron: se dividen antes de reubicar,
+    // así ninguna hoja desbordada recibe partículas que no coinciden.
+    for (const auto& batch : oversized) {
+        for (QuadNode* leaf : batch) {
+            leaf->split();
+            leaf->refreshSweep();
+        }
+    }
+
+    // Los nodos no se liberan hasta collapse(), así que la hoja de origen sigue
+    // siendo un punto de partida válido aunque se haya subdividido entretanto.
+    for (const auto& batch : escaped) {
+        displaced += batch.size();
+        for (const auto& [leaf, particle, slot] : batch) {
+            leaf->markDirty();
+            if (!leaf->relocateParticle(particle, slot)) { insert(particle, slot); }
+        }
+    }
+    collapse();
+
+    finishFrame();
+}
+
+const TreeVersion& QuadTree::commitVersion() {
+    versions.emplace_back(root->snapshot(), frame);
+    while (versions.size() > std::max<size_t>(versionRetention, 1)) { versions.pop_front(); }
+    return versions.back();
+}
+
+void QuadTree::growRoot(const Point2D& toward) {
+    // La raíz actual pasa a ser un cuadrante de un padre del doble de tamaño,
+    // extendido en la dirección del punto: O(1) por nivel, sin reconstruir.
+    Point2D Pmin = root->getBoundary().getPmin();
+    Point2D Pmax = root->getBoundary().getPmax();
+    NType width = Pmax.getX() - Pmin.getX();
+    NType height = Pmax.getY() - Pmin.getY();
+    if (width <= 0) { width = 1; }
+    if (height <= 0) { height = 1; }
+
+    bool west = toward.getX() < Pmin.getX();
+    bool south = toward.getY() < Pmin.getY();
+    NType xmin = west ? Pmin.getX() - width : Pmin.getX();
+    NType xmax = west ? Pmax.getX() : Pmax.getX() + width;
+    NType ymin = south ? Pmin.getY() - height : Pmin.getY();
+    NType ymax = south ? Pmax.getY() : Pmax.getY() + height;
+    NType cx = west ? Pmin.getX() : Pmax.getX();
+    NType cy = south ? Pmin.getY() : Pmax.getY();
+
+    auto newRoot = std::make_unique<QuadNode>(xmin, ymin, xmax, ymax);
+    newRoot->depth = root->depth - 1;
+    newRoot->children[0] = std::make_unique<QuadNode>(xmin, cy, cx, ymax, newRoot.get()); // NW
+    newRoot->children[1] = std::make_unique<QuadNode>(cx, cy, xmax, ymax, newRoot.get()); // NE
+    newRoot->children[2] = std::make_unique<QuadNode>(xmin, ymin, cx, cy, newRoot.get()); // SW
+    newRoot->children[3] = std::make_unique<QuadNode>(cx, ymin, xmax, cy, newRoot.get()); // SE
+
+    // Se reutiliza el nodo raíz (y su boundary exacto) en lugar del cuadrante recién creado
+    size_t index = (south ? 0 : 2) + (west ? 1 : 0);
+    root->setParent(newRoot.get());
+    newRoot->maxSweep = root->maxSweep;
+    newRoot->dirty = root->dirty;
+    newRoot->children[index] = std::move(root);
+    newRoot->_isLeaf = false;
+    root = std::move(newRoot);
+}
+
+void QuadTree::shrinkRoot() {
+    while (!root->isLeaf()) {
+        size_t nonEmptyChildCount = 0, index = 0;
+        for (size_t i = 0; i < root->children.size(); ++i) {
+            const auto& child = root->children[i];
+            if (!child->isLeaf() || !child->particles.empty()) {
+                nonEmptyChildCount++;
+                index = i;
+            }
+        }
+
+        if (nonEmptyChildCount != 1 || !domain.isWithin(root->children[index]->getBoundary())) { return; }
+
+        std::unique_ptr<QuadNode> child = std::move(root->children[index]);
+        child->setParent(nullptr);
+        root = std::move(child);
+    }
+}
+
+void QuadTree::tuneNode(QuadNode* node) {
+    if (node->isLeaf()) {
+        size_t scans = node->queryScans.exchange(0, std::memory_order_relaxed);
+        size_t churn = node->churn;
+        node->churn = 0;
+
+        // Hojas muy consultadas se achican (menos partículas por examinar);
+        // hojas con mucha rotación crecen (menos divisiones y colapsos).
+        size_t capacity = node->getCapacity();
+        if (scans > 2 * churn) {
+            capacity = std::max(adaptive.minBucket, capacity * 3 / 4);
+        } else if (churn > 2 * scans) {
+            capacity = std::min(adaptive.maxBucket, capacity + std::max<size_t>(1, capacity / 2));
+        }
+        node->capacity = capacity;
+        node->mergeThreshold = static_cast<size_t>(capacity * adaptive.hysteresis);
+
+        if (node->particles.size() > capacity && node->canSubdivide() && !node->isCoincident()) {
+            node->split();
+        }
+        return;
+    }
+
+    // Un nodo interno solo se fusiona si el resultado cabe en la menor de las capacidades
+    size_t capacity = adaptive.maxBucket;
+    for (const auto& child : node->children) {
+        tuneNode(child.get());
+        capacity = std::min(capacity, child->getCapacity());
+    }
+    node->capacity = capacity;
+    node->mergeThreshold = static_cast<size_t>(capacity * adaptive.hysteresis);
+}
+
+TuningReport QuadTree::getTuningReport() const {
+    std::vector<QuadNode*> leaves;
+    collectLeaves(root.get(), leaves);
+
+    TuningReport report;
+    report.leaves = leaves.size();
+    report.minCapacity = leaves.empty() ? 0 : leaves.front()->getCapacity();
+    size_t totalCapacity = 0, weightedCapacity = 0, totalParticles = 0;
+    for (const auto& leaf : leaves) {
+        size_t capacity = leaf->getCapacity();
+        report.minCapacity = std::min(report.minCapacity, capacity);
+        report.maxCapacity = std::max(report.maxCapacity, capacity);
+        totalCapacity += capacity;
+        weightedCapacity += capacity * leaf->particles.size();
+        totalParticles += leaf->particles.size();
+    }
+    if (!leaves.empty()) { report.meanCapacity = static_cast<double>(totalCapacity) / leaves.size(); }
+    report.recommendedBucketSize = totalParticles > 0 ? (weightedCapacity + totalParticles / 2) / totalParticles : QuadTree::bucketSize;
+    return report;
+}
+
+void QuadTree::collectLeaves(QuadNode* node, std::vector<QuadNode*>& leaves) const {
+    // El orden NW, NE, SW, SE del recorrido en profundidad sigue la curva de Morton
+    if (node->isLeaf()) {
+        leaves.push_back(node);
+        return;
+    }
+    for (const auto& child : node->children) {
+        if (child) { collectLeaves(child.get(), leaves); }
+    }
+}
+
+std::unique_ptr<QuadNode> QuadTree::relocate(QuadNode* node, QuadNode* parent) {
+    auto copy = std::make_unique<QuadNode>(node->boundary, parent);
+    copy->particles = std::vector<std::shared_ptr<Particle>>(std::make_move_iterator(node->particles.begin()),
+                                                             std::make_move_iterator(node->particles.end()));
+    copy->slots = std::vector<uint32_t>(node->slots.begin(), node->slots.end());
+    copy->_isLeaf = node->_isLeaf;
+    copy->depth = node->depth;
+    copy->maxSweep = node->maxSweep;
+    copy->dirty = node->dirty;
+    copy->capacity = node->capacity;
+    copy->mergeThreshold = node->mergeThreshold;
+    copy->queryScans = node->queryScans.load(std::memory_order_relaxed);
+    copy->churn = node->churn;
+    copy->version = std::move(node->version);
+
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        if (node->children[i]) { copy->children[i] = relocate(node->children[i].get(), copy.get()); }
+    }
+    return copy;
+}
+
+void QuadTree::compact() {
+    // Nodos y buckets se reservan de nuevo en preorden, de modo que el descenso
+    // por el árbol y los buckets de hojas vecinas recorran memoria contigua.
+    root = relocate(root.get(), nullptr);
+
+    std::vector<QuadNode*> leaves;
+    collectLeaves(root.get(), leaves);
+
+    // La copia propia se reescribe en el orden de Morton de las hojas; los huecos
+    // dejados por eliminaciones desaparecen.
+    std::vector<Particle> ordered;
+    ordered.reserve(indexed);
+    for (const auto& leaf : leaves) {
+        for (size_t i = 0; i < leaf->slots.size(); ++i) {
+            ordered.push_back(storage[leaf->slots[i]]);
+            leaf->slots[i] = static_cast<uint32_t>(ordered.size() - 1);
+            slotOf[leaf->particles[i].get()] = leaf->slots[i];
+        }
+    }
+    storage.swap(ordered);
+    freeSlots.clear();
+
+    displaced = 0;
+    framesSinceCompaction = 0;
+}
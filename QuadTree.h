@@ -3,9 +3,17 @@
 
 #include "Particle.h"
 #include "Rect.h"
+#include "TreeVersion.h"
 #include <vector>
 #include <memory>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
 
 class Counter {
 public:
@@ -15,77 +23,359 @@ public:
 class QuadTree;
 
 class QuadNode {
+    friend class QuadTree;
+
 private:
     std::vector<std::shared_ptr<Particle>> particles;
+    std::vector<uint32_t> slots; // copia de cada partícula en QuadTree::storage (paralelo a particles)
     std::array<std::unique_ptr<QuadNode>, 4> children; // NW, NE, SW, SE
     Rect boundary;
     QuadNode* parent;
     bool _isLeaf;
+    NType maxSweep; // cota superior del desplazamiento por paso en el subárbol
+    bool dirty;     // hay hojas con eliminaciones pendientes de colapsar en el subárbol
+    int depth;      // niveles por debajo del dominio inicial; negativo en raíces de growRoot()
+
+    // Umbrales propios del nodo para el modo adaptativo (0 = QuadTree::bucketSize / sin fusión)
+    size_t capacity = 0;
+    size_t mergeThreshold = 0;
+    // Costo medido desde el último ajuste: partículas examinadas por consultas y partículas que salieron
+    mutable std::atomic<size_t> queryScans{0};
+    size_t churn = 0;
+
+    // Última versión persistente de este subárbol (se reutiliza si no cambió)
+    std::shared_ptr<const VersionNode> version;
 
-    void addToBucket(const std::shared_ptr<Particle>& particle);
-    bool propagate(const std::shared_ptr<Particle>& particle);
+    void addToBucket(const std::shared_ptr<Particle>& particle, uint32_t slot);
+    bool propagate(const std::shared_ptr<Particle>& particle, uint32_t slot);
     void subdivide();
+    void split();
+    size_t quadrantOf(const Point2D& point) const;
 
-    void relocateParticle(const std::shared_ptr<Particle>& particle);
+    bool insert(const std::shared_ptr<Particle>& particle, uint32_t slot);
+    bool relocateParticle(const std::shared_ptr<Particle>& particle, uint32_t slot);
     void removeEmptyNode();
+    void refreshSweep();
+    // Eleva maxSweep de los ancestros hasta 'sweep' (se detiene donde ya lo cubren)
+    void raiseSweep(NType sweep);
+
+    // Reubica las partículas que salieron de su hoja; devuelve cuántas cambiaron de hoja
+    size_t updateNode(std::vector<std::pair<std::shared_ptr<Particle>, uint32_t>>& outOfBounds);
+
+    // Quita la entrada 'slot' descendiendo por 'position', la posición con la que se indexó
+    bool erase(const Point2D& position, uint32_t slot);
+    void markDirty();
+    void collapseDirty();
+
+    std::shared_ptr<const VersionNode> snapshot();
+
+    // La hoja llena y 'position' forman un grupo de puntos coincidentes
+    bool coincidesWith(const Point2D& position) const;
 
 public:
     QuadNode(NType xmin, NType ymin, NType xmax, NType ymax, QuadNode* parent = nullptr)
-        : boundary(Point2D(xmin,ymin),Point2D(xmax,ymax)), parent(parent), _isLeaf(true) {}
+        : boundary(Point2D(xmin,ymin),Point2D(xmax,ymax)), parent(parent), _isLeaf(true), maxSweep(0), dirty(false),
+          depth(parent ? parent->depth + 1 : 0) {}
     QuadNode(const Rect& boundary, QuadNode* parent = nullptr)
-        : boundary(boundary), parent(parent), _isLeaf(true) {}
-
-    bool insert(const std::shared_ptr<Particle>& particle);
-    void updateNode();
+        : boundary(boundary), parent(parent), _isLeaf(true), maxSweep(0), dirty(false), depth(parent ? parent->depth + 1 : 0) {}
 
     // Getters
     const std::vector<std::shared_ptr<Particle>>& getParticles() const { return particles; }
+    const std::vector<uint32_t>& getSlots() const { return slots; }
     const std::unique_ptr<QuadNode>& getChild(size_t index) const { return children[index]; }
     const std::array<std::unique_ptr<QuadNode>, 4>& getChildren() const { return children; }
     const Rect& getBoundary() const { return boundary; }
     const QuadNode* getParent() const { return parent; }
+    NType getMaxSweep() const { return maxSweep; }
 
     // Setters
     void setParent(QuadNode* parent) { this->parent = parent; }
 
     bool isLeaf() const { return _isLeaf; }
+
+    // Cantidad de partículas a partir de la cual la hoja se subdivide
+    size_t getCapacity() const;
+
+    // Profundidad respecto del dominio inicial del árbol: no cambia cuando growRoot()
+    // o shrinkRoot() agregan o quitan niveles por encima
+    int getDepth() const { return depth; }
+
+    // Una hoja que ya no puede subdividirse (QuadTree::maxDepth o QuadTree::minCellSize)
+    // se convierte en un bucket de desbordamiento sin límite de partículas.
+    bool canSubdivide() const;
+
+    // Todas las partículas de la hoja coinciden (con el epsilon de Safe). Una hoja llena
+    // de puntos coincidentes no se divide: ninguna subdivisión podría separarlos.
+    bool isCoincident() const;
 };
 
 
+// Configuración del ajuste adaptativo de capacidades por nodo
+struct AdaptiveConfig {
+    bool enabled = false;
+    size_t minBucket = 2;
+    size_t maxBucket = 64;
+    float hysteresis = 0.5f;    // fracción de la capacidad por debajo de la cual se fusionan hermanos
+    size_t tuneInterval = 1;    // frames entre ajustes
+};
+
+// Resumen de las capacidades elegidas, para reutilizarlas como bucketSize estático
+struct TuningReport {
+    size_t leaves = 0;
+    size_t minCapacity = 0;
+    size_t maxCapacity = 0;
+    double meanCapacity = 0;
+    size_t recommendedBucketSize = 0; // media ponderada por partículas
+
+    friend std::ostream& operator<<(std::ostream& os, const TuningReport& report) {
+        os << "leaves: " << report.leaves << ", capacity min/mean/max: " << report.minCapacity << "/"
+           << report.meanCapacity << "/" << report.maxCapacity << ", recommended bucketSize: " << report.recommendedBucketSize;
+        return os;
+    }
+};
+
+// Grafo de k vecinos más cercanos de todas las partículas, en formato CSR
+struct KnnGraph {
+    std::vector<std::shared_ptr<Particle>> particles; // id -> partícula, en orden de hojas
+    std::vector<size_t> offsets;                      // vecinos de i: neighbors[offsets[i] .. offsets[i + 1])
+    std::vector<uint32_t> neighbors;                  // ids de vecinos, de menor a mayor distancia
+};
+
 class QuadTree {
 private:
     std::unique_ptr<QuadNode> root;
+    Rect domain; // boundary inicial; la raíz nunca se reduce por debajo de él
+
+    // Crecimiento de la raíz para partículas fuera de sus límites
+    bool autoGrow = true;
+    bool autoShrink = false;
+    std::vector<std::shared_ptr<Particle>> outOfBounds;
+
+    void growRoot(const Point2D& toward);
+
+    AdaptiveConfig adaptive;
+    size_t framesSinceTuning = 0;
+
+    // Versiones persistentes por frame (path copying)
+    size_t versionRetention = 0; // 0 = desactivado
+    size_t frame = 0;
+    std::deque<TreeVersion> versions;
+
+    void tuneNode(QuadNode* node);
+
+    // Partículas examinadas en una hoja por una consulta; alimenta tuneNode()
+    void countScans(const QuadNode* leaf, size_t scanned) const {
+        if (adaptive.enabled) { leaf->queryScans.fetch_add(scanned, std::memory_order_relaxed); }
+    }
+
+    // Tareas comunes al final de cada frame (updateTree() y step())
+    void finishFrame() {
+        frame++;
+        if (autoShrink) { shrinkRoot(); }
+
+        if (adaptive.enabled && ++framesSinceTuning >= adaptive.tuneInterval) {
+            tuneNode(root.get());
+            framesSinceTuning = 0;
+        }
+
+        framesSinceCompaction++;
+        if ((compactionInterval > 0 && framesSinceCompaction >= compactionInterval) ||
+            (fragmentationThreshold > 0 && fragmentation() > fragmentationThreshold)) {
+            compact();
+        }
+
+        if (versionRetention > 0) { commitVersion(); }
+    }
+
+    // Copia propia de las partículas indexadas, contigua y reordenable por compact().
+    // Los objetos de los handles del usuario nunca se modifican al reordenar.
+    std::vector<Particle> storage;
+    std::vector<uint32_t> freeSlots;
+    std::unordered_map<const Particle*, uint32_t> slotOf; // handle -> copia, para erase()
+    size_t indexed = 0;     // partículas en el árbol
+    size_t displaced = 0;   // insertadas o cambiadas de hoja desde el último compact()
+
+    uint32_t allocateSlot(const std::shared_ptr<Particle>& particle);
+    void syncStorage();
+    void releaseSlot(const std::shared_ptr<Particle>& particle, uint32_t slot);
+    bool insert(const std::shared_ptr<Particle>& particle, uint32_t slot);
+
+    // Reordenamiento periódico de la memoria (ver compact())
+    size_t compactionInterval = 0;      // 0 = desactivado
+    float fragmentationThreshold = 0;   // 0 = desactivado
+    size_t framesSinceCompaction = 0;
+
+    void collectLeaves(QuadNode* node, std::vector<QuadNode*>& leaves) const;
+
+    // Copia del subárbol reservada en preorden (NW, NE, SW, SE), usada por compact()
+    std::unique_ptr<QuadNode> relocate(QuadNode* node, QuadNode* parent);
+    void rangeQuery(const QuadNode* node, const Rect& range, std::vector<std::shared_ptr<Particle>>& result) const;
+    void sweptQuery(const QuadNode* node, const std::shared_ptr<Particle>& handle, const Particle& particle, const Rect& sweep, NType radius,
+                    std::vector<std::shared_ptr<Particle>>& result) const;
 
 public:
     static size_t bucketSize;
+    static size_t maxDepth;
+    static NType minCellSize;
 
     // Constructors
     QuadTree(NType xmin, NType ymin, NType xmax, NType ymax, size_t bucketSize) 
-        : root(std::make_unique<QuadNode>(Rect(Point2D(xmin,ymin),Point2D(xmax,ymax)))) {
+        : root(std::make_unique<QuadNode>(Rect(Point2D(xmin,ymin),Point2D(xmax,ymax)))), domain(Point2D(xmin,ymin),Point2D(xmax,ymax)) {
         QuadTree::bucketSize = bucketSize; 
     }
     QuadTree(const Rect& boundary, size_t bucketSize) 
-        : root(std::make_unique<QuadNode>(boundary)) {
+        : root(std::make_unique<QuadNode>(boundary)), domain(boundary) {
         QuadTree::bucketSize = bucketSize; 
     }
     QuadTree(NType xmin, NType ymin, NType xmax, NType ymax) 
-        : root(std::make_unique<QuadNode>(Rect(Point2D(xmin,ymin),Point2D(xmax,ymax)))) {}
+        : root(std::make_unique<QuadNode>(Rect(Point2D(xmin,ymin),Point2D(xmax,ymax)))), domain(Point2D(xmin,ymin),Point2D(xmax,ymax)) {}
     QuadTree(const Rect& boundary) 
-        : root(std::make_unique<QuadNode>(boundary)) {}
+        : root(std::make_unique<QuadNode>(boundary)), domain(boundary) {}
+
+    // Si la partícula cae fuera de la raíz, la raíz crece hacia ella (autoGrow);
+    // en caso contrario queda en outOfBounds y se devuelve false.
+    bool insert(const std::shared_ptr<Particle>& particle);
 
     void insert(const std::vector<std::shared_ptr<Particle>>& particles) {
         for (const auto& particle : particles) {
-            root->insert(particle);
+            insert(particle);
         }
     }
 
     const std::unique_ptr<QuadNode>& getRoot() const { return root; }
+    const Rect& getDomain() const { return domain; }
+
+    // Partículas indexadas (sin contar outOfBounds), en O(1)
+    size_t size() const { return indexed; }
+
+    // Con autoGrow desactivado, las partículas fuera de la raíz se acumulan aquí
+    std::vector<std::shared_ptr<Particle>> takeOutOfBounds() { return std::move(outOfBounds); }
+
+    // Modo adaptativo: al final de cada frame las hojas ajustan su capacidad según
+    // el costo medido de las consultas (reducir) y la rotación de partículas (aumentar).
+    void setAdaptive(const AdaptiveConfig& config) { adaptive = config; }
+    TuningReport getTuningReport() const;
+
+    // Modo persistente: cada frame guarda una versión consultable que comparte con la
+    // anterior todos los subárboles sin cambios. Se conservan las últimas 'retention'.
+    void setVersioning(size_t retention) {
+        versionRetention = retention;
+        while (versions.size() > versionRetention) { versions.pop_front(); }
+    }
 
+    // Crea la versión del frame actual clonando solo los caminos modificados
+    const TreeVersion& commitVersion();
+
+    // framesAgo = 0 es la versión más reciente. Lanza std::out_of_range si esa versión
+    // no se conserva (incluido el árbol sin ninguna versión).
+    const TreeVersion& getVersion(size_t framesAgo) const {
+        if (framesAgo >= versions.size()) {
+            throw std::out_of_range("Versión no conservada: " + std::to_string(framesAgo) + " frames atrás");
+        }
+        return versions[versions.size() - 1 - framesAgo];
+    }
+    const std::deque<TreeVersion>& getVersions() const { return versions; }
+
+    void setAutoGrow(bool enabled) { autoGrow = enabled; }
+    void setAutoShrink(bool enabled) { autoShrink = enabled; }
+
+    // Mientras todo el contenido esté en un solo cuadrante que cubra el dominio
+    // inicial, ese cuadrante pasa a ser la nueva raíz.
+    void shrinkRoot();
+
+    // Elimina la partícula y marca su hoja como sucia; los nodos vacíos no se
+    // colapsan hasta la siguiente llamada a collapse() o updateTree().
+    // La hoja se busca por la posición de la copia del árbol, no la del handle: O(profundidad)
+    // aunque la partícula se haya movido desde la última actualización.
+    bool erase(const std::shared_ptr<Particle>& particle) {
+        auto it = slotOf.find(particle.get());
+        if (it == slotOf.end()) { return false; }
+        uint32_t slot = it->second;
+        if (!root->erase(storage[slot].getPosition(), slot)) { return false; }
+        releaseSlot(particle, slot);
+        return true;
+    }
+
+    // Elimina todas las partículas y colapsa los nodos vacíos en una sola pasada.
+    // Devuelve la cantidad de partículas eliminadas.
+    size_t eraseBatch(const std::vector<std::shared_ptr<Particle>>& particles) {
+        size_t erased = 0;
+        for (const auto& particle : particles) {
+            if (erase(particle)) { erased++; }
+        }
+        collapse();
+        return erased;
+    }
+
+    // Colapsa los nodos vacíos recorriendo solo los subárboles marcados como sucios
+    void collapse() {
+        root->collapseDirty();
+    }
+
+    // Las consultas leen la copia del árbol: reflejan las posiciones del último
+    // insert(), updateTree() o step(), no cambios posteriores hechos por los handles.
     void updateTree() {
-        root->updateNode();
+        // La copia se sincroniza antes de reubicar: una división durante la reubicación
+        // puede mover partículas a hojas que updateNode() ya recorrió.
+        syncStorage();
+
+        std::vector<std::pair<std::shared_ptr<Particle>, uint32_t>> escaped;
+        displaced += root->updateNode(escaped);
+        for (const auto& [particle, slot] : escaped) {
+            insert(particle, slot);
+        }
+        finishFrame();
+    }
+
+    // Integra y reindexa en una sola pasada por las hojas, en paralelo: cada hoja
+    // mueve sus partículas, conserva las que siguen dentro y reubica las que salieron
+    // al terminar la pasada. Equivale al bucle de Particle::updatePosition seguido de
+    // updateTree(), pero no es más barato en un solo hilo: el bucle que ahorra recorre
+    // los handles en orden y cuesta ~1% del frame, cada partícula se sigue escribiendo
+    // dos veces (handle y copia del árbol) y la reubicación, que domina el costo, es
+    // la misma. Lo que gana es que la pasada por hojas se reparte entre los hilos.
+    void step(const Rect& boundary, NType dt);
+    void step(NType dt) { step(domain, dt); }
+
+    // Reserva de nuevo los nodos y buckets en preorden y reescribe la copia propia de
+    // las partículas en orden de Morton, de modo que hojas vecinas y sus partículas
+    // queden contiguas en memoria.
+    // Solo se mueven datos del árbol: los handles siguen apuntando a la misma partícula.
+    void compact();
+
+    // Fracción de partículas fuera del orden de Morton (insertadas o cambiadas de
+    // hoja desde el último compact()): 0 tras compact(), 1 si ninguna está en orden.
+    float fragmentation() const {
+        return indexed == 0 ? 0.0f : std::min(1.0f, static_cast<float>(displaced) / static_cast<float>(indexed));
+    }
+
+    // Copia del árbol de la partícula de un bucket: getStorage()[node->getSlots()[i]]
+    const std::vector<Particle>& getStorage() const { return storage; }
+
+    // compact() se ejecuta en updateTree() cada 'interval' frames o cuando
+    // fragmentation() supera 'threshold'. Un valor de 0 desactiva cada criterio.
+    void setCompactionPolicy(size_t interval, float threshold) {
+        compactionInterval = interval;
+        fragmentationThreshold = threshold;
     }
 
     std::vector<std::shared_ptr<Particle>> knn(Point2D query, size_t k);
+
+    // k vecinos de cada partícula (sin incluirse a sí misma) en una pasada paralela por hojas:
+    // las hojas cercanas se recorren una vez y sirven de candidatas a todas las partículas de la hoja.
+    KnnGraph knnGraph(size_t k) const;
+
+    // Partículas cuya posición está dentro de 'range'
+    std::vector<std::shared_ptr<Particle>> rangeQuery(const Rect& range) const;
+
+    // Partículas cuyo recorrido del próximo paso (position -> position + velocity*timeStep)
+    // pasa a menos de 'radius' del recorrido de 'particle'.
+    std::vector<std::shared_ptr<Particle>> sweptQuery(const std::shared_ptr<Particle>& particle, NType radius) const;
+
+    // Todos los pares de partículas cuyos recorridos pasan a menos de 'radius', en una
+    // pasada paralela por hojas; cada par se prueba una vez y se reporta con el
+    // handle de menor dirección primero.
+    std::vector<std::pair<std::shared_ptr<Particle>, std::shared_ptr<Particle>>> sweptCollisions(NType radius) const;
 };
 
 #endif // QUADTREE_H
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <cmath>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "ShardedTree.h"
+#include "Parallel.h"
+
+static void pinToCpu(size_t cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)cpu;
+#endif
+}
+
+ShardedTree::ShardedTree(const Rect& domain, size_t columns, size_t rows)
+    : domain(domain), columns(std::max<size_t>(columns, 1)), rows(std::max<size_t>(rows, 1)) {
+    Point2D Pmin = domain.getPmin();
+    Point2D Pmax = domain.getPmax();
+    NType width = (Pmax.getX() - Pmin.getX()) / static_cast<float>(this->columns);
+    NType height = (Pmax.getY() - Pmin.getY()) / static_cast<float>(this->rows);
+
+    for (size_t row = 0; row < this->rows; ++row) {
+        for (size_t column = 0; column < this->columns; ++column) {
+            // Los bordes exteriores se copian del dominio para no perder puntos por redondeo
+            NType xmin = column == 0 ? Pmin.getX() : Pmin.getX() + width * static_cast<float>(column);
+            NType ymin = row == 0 ? Pmin.getY() : Pmin.getY() + height * static_cast<float>(row);
+            NType xmax = column + 1 == this->columns ? Pmax.getX() : Pmin.getX() + width * static_cast<float>(column + 1);
+            NType ymax = row + 1 == this->rows ? Pmax.getY() : Pmin.getY() + height * static_cast<float>(row + 1);
+
+            auto shard = std::make_unique<Shard>();
+            shard->boundary = Rect(Point2D(xmin, ymin), Point2D(xmax, ymax));
+            shards.push_back(std::move(shard));
+        }
+    }
+
+    for (size_t i = 0; i < shards.size(); ++i) {
+        shards[i]->worker = std::thread(&ShardedTree::workerLoop, this, i);
+    }
+
+    // El árbol de cada shard se crea en su propio hilo (first-touch)
+    run([](Shard& shard) {
+        shard.tree = std::make_unique<QuadTree>(shard.boundary);
+        shard.tree->setAutoGrow(false);
+    });
+}
+
+ShardedTree::~ShardedTree() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& shard : shards) { shard->worker.join(); }
+}
+
+void ShardedTree::workerLoop(size_t index) {
+    // Shards consecutivos en CPUs consecutivas: las celdas vecinas de una misma
+    // fila suelen quedar en el mismo nodo NUMA.
+    size_t hardware = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+    pinToCpu(index % hardware);
+
+    // Los shards ya ocupan los núcleos; las pasadas internas de QuadTree no abren más hilos
+    insideParallelRegion = true;
+
+    size_t seen = 0;
+    Shard& shard = *shards[index];
+    while (true) {
+        std::function<void(Shard&)> current;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping) { return; }
+            seen = generation;
+            current = task;
+        }
+
+        current(shard);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0) { finished.notify_one(); }
+    }
+}
+
+void ShardedTree::run(std::function<void(Shard&)> phase) {
+    std::unique_lock<std::mutex> lock(mutex);
+    task = std::move(phase);
+    pending = shards.size();
+    generation++;
+    wake.notify_all();
+    finished.wait(lock, [&]() { return pending == 0; });
+}
+
+size_t ShardedTree::shardOf(const Point2D& point) const {
+    Point2D Pmin = domain.getPmin();
+    Point2D Pmax = domain.getPmax();
+    float u = (point.getX() - Pmin.getX()).getValue() / (Pmax.getX() - Pmin.getX()).getValue();
+    float v = (point.getY() - Pmin.getY()).getValue() / (Pmax.getY() - Pmin.getY()).getValue();
+
+    auto cell = [](float t, size_t cells) -> size_t {
+        if (!(t > 0)) { return 0; }
+        return std::min(static_cast<size_t>(t * static_cast<float>(cells)), cells - 1);
+    };
+    size_t column = cell(u, columns);
+    size_t row = cell(v, rows);
+
+    // El redondeo de la división puede caer en la celda vecina
+    size_t index = row * columns + column;
+    if (!shards[index]->boundary.contains(point)) {
+        if (column > 0 && point.getX() < shards[index]->boundary.getPmin().getX()) { column--; }
+        else if (column + 1 < columns && point.getX() > shards[index]->boundary.getPmax().getX()) { column++; }
+        if (row > 0 && point.getY() < shards[index]->boundary.getPmin().getY()) { row--; }
+        else if (row + 1 < rows && point.getY() > shards[index]->boundary.getPmax().getY()) { row++; }
+        index = row * columns + column;
+    }
+    return index;
+}
+
+void ShardedTree::handoff() {
+    run([this](Shard& shard) {
+        for (auto& particle : shard.tree->takeOutOfBounds()) {
+            shards[shardOf(particle->getPosition())]->inbox.push(std::move(particle));
+        }
+    });
+
+    run(drainInbox);
+}
+
+void ShardedTree::drainInbox(Shard& shard) {
+    shard.inbox.drain([&](std::shared_ptr<Particle>&& particle) { shard.tree->insert(particle); });
+
+    // shardOf() ya eligió el shard más cercano, así que si su árbol no la acepta la
+    // partícula está fuera del dominio; se aparta para no reencolarla en cada handoff
+    for (auto& particle : shard.tree->takeOutOfBounds()) {
+        shard.outOfDomain.push_back(std::move(particle));
+    }
+}
+
+void ShardedTree::insert(const std::vector<std::shared_ptr<Particle>>& particles) {
+    for (const auto& particle : particles) {
+        shards[shardOf(particle->getPosition())]->inbox.push(particle);
+    }
+    run(drainInbox);
+}
+
+std::vector<std::shared_ptr<Particle>> ShardedTree::takeOutOfDomain() {
+    std::vector<std::shared_ptr<Particle>> result;
+    for (auto& shard : shards) {
+        result.insert(result.end(), shard->outOfDomain.begin(), shard->outOfDomain.end());
+        shard->outOfDomain.clear();
+    }
+    return result;
+}
+
+void ShardedTree::step(NType dt) {
+    run([this, dt](Shard& shard) { shard.tree->step(domain, dt); });
+    handoff();
+}
+
+void ShardedTree::updateTree() {
+    run([](Shard& shard) { shard.tree->updateTree(); });
+    handoff();
+}
+
+static float squaredDistance(const Point2D& a, const Point2D& b) {
+    float dx = (a.getX() - b.getX()).getValue();
+    float dy = (a.getY() - b.getY()).getValue();
+    return dx * dx + dy * dy;
+}
+
+std::vector<std::shared_ptr<Particle>> ShardedTree::knn(Point2D query, size_t k) {
+    // Shards de más cercano a más lejano; el de la consulta queda primero (distancia 0)
+    std::vector<std::pair<float, size_t>> order;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        order.emplace_back(shards[i]->boundary.distance(query).getValue(), i);
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<std::pair<float, std::shared_ptr<Particle>>> candidates;
+    for (const auto& [distance, index] : order) {
+        if (candidates.size() >= k && distance * distance > candidates.back().first) { break; }
+
+        for (const auto& particle : shards[index]->tree->knn(query, k)) {
+            candidates.emplace_back(squaredDistance(query, particle->getPosition()), particle);
+        }
+        std::stable_sort(candidates.begin(), candidates.end(),
+                         [](const auto& a, const auto& b) { return a.first < b.first; });
+        if (candidates.size() > k) { candidates.resize(k); }
+    }
+
+    std::vector<std::shared_ptr<Particle>> result;
+    for (const auto& candidate : candidates) { result.push_back(candidate.second); }
+    return result;
+}
+
+std::vector<std::shared_ptr<Particle>> ShardedTree::rangeQuery(const Rect& range) const {
+    std::vector<std::shared_ptr<Particle>> result;
+    for (const auto& shard : shards) {
+        const Rect& bounds = shard->boundary;
+        if (bounds.getPmax().getX() < range.getPmin().getX() || bounds.getPmin().getX() > range.getPmax().getX() ||
+            bounds.getPmax().getY() < range.getPmin().getY() || bounds.getPmin().getY() > range.getPmax().getY()) {
+            continue;
+        }
+        std::vector<std::shared_ptr<Particle>> found = shard->tree->rangeQuery(range);
+        result.insert(result.end(), found.begin(), found.end());
+    }
+    return result;
+}
+
+size_t ShardedTree::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards) { total += shard->tree->size(); }
+    return total;
+}
@@ -0,0 +1,127 @@
+#ifndef SHARDEDTREE_H
+#define SHARDEDTREE_H
+
+#include "QuadTree.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Cola MPSC sin locks para pasar partículas entre shards: los productores
+// apilan con CAS y el dueño del shard se lleva la lista entera con un exchange.
+class HandoffQueue {
+private:
+    struct Node {
+        std::shared_ptr<Particle> particle;
+        Node* next;
+    };
+    std::atomic<Node*> head{nullptr};
+
+public:
+    HandoffQueue() = default;
+    HandoffQueue(const HandoffQueue&) = delete;
+    HandoffQueue& operator=(const HandoffQueue&) = delete;
+    ~HandoffQueue() { drain([](std::shared_ptr<Particle>&&) {}); }
+
+    void push(std::shared_ptr<Particle> particle) {
+        Node* node = new Node{std::move(particle), head.load(std::memory_order_relaxed)};
+        while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+
+    // Entrega las partículas en el orden en que se encolaron
+    template <typename Consumer>
+    size_t drain(Consumer consume) {
+        Node* node = head.exchange(nullptr, std::memory_order_acquire);
+        Node* ordered = nullptr;
+        while (node) {
+            Node* next = node->next;
+            node->next = ordered;
+            ordered = node;
+            node = next;
+        }
+
+        size_t count = 0;
+        while (ordered) {
+            Node* next = ordered->next;
+            consume(std::move(ordered->particle));
+            delete ordered;
+            ordered = next;
+            count++;
+        }
+        return count;
+    }
+};
+
+// Motor con el dominio dividido en una grilla de QuadTree independientes. Cada
+// shard tiene un hilo propio fijado a una CPU que construye y modifica su árbol,
+// de modo que los nodos se reservan (first-touch) en la memoria local de esa CPU.
+// Las partículas que cruzan el borde de un shard pasan al vecino por su HandoffQueue.
+class ShardedTree {
+public:
+    struct Shard {
+        Rect boundary;
+        std::unique_ptr<QuadTree> tree;
+        HandoffQueue inbox;
+        std::thread worker;
+        // Partículas que ni el shard más cercano acepta: están fuera del dominio
+        std::vector<std::shared_ptr<Particle>> outOfDomain;
+    };
+
+private:
+    Rect domain;
+    size_t columns, rows;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    // Despacho de fases a los hilos de los shards
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    std::function<void(Shard&)> task;
+    size_t generation = 0;
+    size_t pending = 0;
+    bool stopping = false;
+
+    void workerLoop(size_t index);
+
+    // Ejecuta task en el hilo de cada shard y espera a que terminen todos
+    void run(std::function<void(Shard&)> phase);
+
+    // Reparte las partículas fuera de cada shard y las inserta en su destino
+    void handoff();
+
+    // Inserta lo recibido en el inbox; lo que el árbol rechaza queda en outOfDomain
+    static void drainInbox(Shard& shard);
+
+public:
+    ShardedTree(const Rect& domain, size_t columns, size_t rows);
+    ~ShardedTree();
+
+    ShardedTree(const ShardedTree&) = delete;
+    ShardedTree& operator=(const ShardedTree&) = delete;
+
+    // Shard cuya celda contiene el punto (los puntos fuera del dominio van al más cercano)
+    size_t shardOf(const Point2D& point) const;
+
+    // Las partículas fuera del dominio no se indexan: se apartan y se recuperan
+    // con takeOutOfDomain(), igual que QuadTree::takeOutOfBounds().
+    void insert(const std::shared_ptr<Particle>& particle) { insert(std::vector<std::shared_ptr<Particle>>{particle}); }
+    void insert(const std::vector<std::shared_ptr<Particle>>& particles);
+    std::vector<std::shared_ptr<Particle>> takeOutOfDomain();
+
+    // Equivalentes de QuadTree::step() y updateTree(), con cada shard en su hilo
+    void step(NType dt);
+    void updateTree();
+
+    // Los shards vecinos solo se consultan si la esfera de los k candidatos
+    // actuales (o el rango) alcanza su celda.
+    std::vector<std::shared_ptr<Particle>> knn(Point2D query, size_t k);
+    std::vector<std::shared_ptr<Particle>> rangeQuery(const Rect& range) const;
+
+    // Partículas indexadas en los shards, sin las que están fuera del dominio
+    size_t size() const;
+    size_t getShardCount() const { return shards.size(); }
+    const Shard& getShard(size_t index) const { return *shards[index]; }
+    const Rect& getDomain() const { return domain; }
+};
+
+#endif // SHARDEDTREE_H
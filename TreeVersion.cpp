@@ -0,0 +1,65 @@
+#include <queue>
+#include "TreeVersion.h"
+
+struct VersionKNNElement {
+    float distance;
+    const VersionNode* node;    // nullptr si es una entrada
+    const VersionEntry* entry;
+};
+
+struct CompareVersionKNNElement {
+    bool operator()(const VersionKNNElement& a, const VersionKNNElement& b) const {
+        return a.distance > b.distance;
+    }
+};
+
+std::vector<VersionEntry> TreeVersion::knn(Point2D query, size_t k) const {
+    std::vector<VersionEntry> knnEntries;
+    std::priority_queue<VersionKNNElement, std::vector<VersionKNNElement>, CompareVersionKNNElement> pq;
+
+    pq.push({root->boundary.distance(query).getValue(), root.get(), nullptr});
+
+    while (!pq.empty() && knnEntries.size() < k) {
+        VersionKNNElement element = pq.top();
+        pq.pop();
+
+        if (!element.node) {
+            knnEntries.push_back(*element.entry);
+        } else if (element.node->isLeaf()) {
+            for (const auto& entry : element.node->entries) {
+                pq.push({query.distance(entry.position).getValue(), nullptr, &entry});
+            }
+        } else {
+            for (const auto& child : element.node->children) {
+                pq.push({child->boundary.distance(query).getValue(), child.get(), nullptr});
+            }
+        }
+    }
+
+    return knnEntries;
+}
+
+static void rangeQuery(const VersionNode* node, const Rect& range, std::vector<VersionEntry>& result) {
+    const Rect& bounds = node->boundary;
+    if (bounds.getPmax().getX() < range.getPmin().getX() || bounds.getPmin().getX() > range.getPmax().getX() ||
+        bounds.getPmax().getY() < range.getPmin().getY() || bounds.getPmin().getY() > range.getPmax().getY()) {
+        return;
+    }
+
+    if (node->isLeaf()) {
+        for (const auto& entry : node->entries) {
+            if (range.contains(entry.position)) { result.push_back(entry); }
+        }
+        return;
+    }
+
+    for (const auto& child : node->children) {
+        rangeQuery(child.get(), range, result);
+    }
+}
+
+std::vector<VersionEntry> TreeVersion::rangeQuery(const Rect& range) const {
+    std::vector<VersionEntry> result;
+    ::rangeQuery(root.get(), range, result);
+    return result;
+}
@@ -0,0 +1,43 @@
+#ifndef TREEVERSION_H
+#define TREEVERSION_H
+
+#include "Particle.h"
+#include "Rect.h"
+#include <vector>
+#include <memory>
+#include <array>
+
+// Partícula tal como estaba en el frame de la versión
+struct VersionEntry {
+    std::shared_ptr<Particle> particle;
+    Point2D position;
+};
+
+// Nodo inmutable de una versión. Los subárboles que no cambiaron entre dos
+// frames son el mismo VersionNode compartido por ambas versiones.
+struct VersionNode {
+    Rect boundary;
+    std::array<std::shared_ptr<const VersionNode>, 4> children; // NW, NE, SW, SE
+    std::vector<VersionEntry> entries;
+
+    bool isLeaf() const { return !children[0]; }
+};
+
+// Handle de solo lectura a un frame pasado del QuadTree. Mientras exista un
+// handle, sus nodos siguen vivos aunque la política de retención lo haya descartado.
+class TreeVersion {
+private:
+    std::shared_ptr<const VersionNode> root;
+    size_t frame;
+
+public:
+    TreeVersion(std::shared_ptr<const VersionNode> root, size_t frame) : root(std::move(root)), frame(frame) {}
+
+    size_t getFrame() const { return frame; }
+    const std::shared_ptr<const VersionNode>& getRoot() const { return root; }
+
+    std::vector<VersionEntry> knn(Point2D query, size_t k) const;
+    std::vector<VersionEntry> rangeQuery(const Rect& range) const;
+};
+
+#endif // TREEVERSION_H
@@ -3,8 +3,12 @@
 #include <random>
 #include <vector>
 #include <algorithm>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
 #include "QuadTree.h"
-size_t QuadTree::bucketSize = 6;
+#include "CompactIndex.h"
+#include "ShardedTree.h"
 
 std::vector<std::shared_ptr<Particle>> generateRandomParticles(int n, const Rect& boundary, NType maxVelocityMagnitude) {
     std::vector<std::shared_ptr<Particle>> particles;
@@ -30,6 +34,46 @@ std::vector<std::shared_ptr<Particle>> generateRandomParticles(int n, const Rect
     return particles;
 }
 
+// Muchas partículas repartidas en pocas posiciones idénticas
+std::vector<std::shared_ptr<Particle>> generateDuplicateParticles(int n, int distinctPositions, const Rect& boundary, NType maxVelocityMagnitude) {
+    std::vector<std::shared_ptr<Particle>> positions = generateRandomParticles(distinctPositions, boundary, maxVelocityMagnitude);
+    std::vector<std::shared_ptr<Particle>> particles;
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> positionDist(0, distinctPositions - 1);
+    std::uniform_real_distribution<float> velDist(-maxVelocityMagnitude.getValue(), maxVelocityMagnitude.getValue());
+
+    for (int i = 0; i < n; ++i) {
+        Point2D position = positions[positionDist(gen)]->getPosition();
+        Point2D velocity(NType(velDist(gen)), NType(velDist(gen)));
+        particles.push_back(std::make_shared<Particle>(position, velocity));
+    }
+
+    return particles;
+}
+
+// Partículas agrupadas en cúmulos gaussianos
+std::vector<std::shared_ptr<Particle>> generateClusteredParticles(int n, int clusters, const Rect& boundary, NType maxVelocityMagnitude) {
+    std::vector<std::shared_ptr<Particle>> centers = generateRandomParticles(clusters, boundary, maxVelocityMagnitude);
+    std::vector<std::shared_ptr<Particle>> particles;
+    std::mt19937 gen(13);
+    std::uniform_int_distribution<int> clusterDist(0, clusters - 1);
+    std::normal_distribution<float> offsetDist(0.0f, 2.0f);
+    std::uniform_real_distribution<float> velDist(-maxVelocityMagnitude.getValue(), maxVelocityMagnitude.getValue());
+
+    for (int i = 0; i < n; ++i) {
+        Point2D center = centers[clusterDist(gen)]->getPosition();
+        Point2D offset(NType(offsetDist(gen)), NType(offsetDist(gen)));
+        Point2D position = center + offset;
+        position.setX(max(boundary.getPmin().getX(), min(boundary.getPmax().getX(), position.getX())));
+        position.setY(max(boundary.getPmin().getY(), min(boundary.getPmax().getY(), position.getY())));
+
+        Point2D velocity(NType(velDist(gen)), NType(velDist(gen)));
+        particles.push_back(std::make_shared<Particle>(position, velocity));
+    }
+
+    return particles;
+}
+
 // Test 1: Verify all data is indexed
 void traverseTree(QuadNode* node, std::set<std::shared_ptr<Particle>>& foundParticles) {
     if (node->isLeaf()) {
@@ -98,16 +142,16 @@ bool verifyLeafNodesHaveNoChildren(QuadNode* rootNode) {
     return traverseAndCheckLeafNodes(rootNode);
 }
 
-// Test 4: Verify leaf nodes have no more than bucketSize elements
-bool traverseAndCheckBucketSize(QuadNode* node, size_t bucketSize) {
+// Test 4: Verify leaf nodes have no more than their capacity (bucketSize unless adaptive), except overflow buckets
+bool traverseAndCheckBucketSize(QuadNode* node) {
     if (node->isLeaf()) {
-        if (node->getParticles().size() > bucketSize) {
+        if (node->getParticles().size() > node->getCapacity() && node->canSubdivide() && !node->isCoincident()) {
             return false;
         }
     } else {
         for (const auto& child : node->getChildren()) {
             if (child) {
-                if (!traverseAndCheckBucketSize(child.get(), bucketSize)) {
+                if (!traverseAndCheckBucketSize(child.get())) {
                     return false;
                 }
             }
@@ -116,8 +160,8 @@ bool traverseAndCheckBucketSize(QuadNode* node, size_t bucketSize) {
     return true;
 }
 
-bool verifyLeafNodesBucketSize(QuadNode* rootNode, size_t bucketSize) {
-    return traverseAndCheckBucketSize(rootNode, bucketSize);
+bool verifyLeafNodesBucketSize(QuadNode* rootNode) {
+    return traverseAndCheckBucketSize(rootNode);
 }
 
 // Test 5: Verify child boundaries are within parent boundaries
@@ -240,6 +284,95 @@ bool verifyKnnSearch(QuadTree& tree, const std::vector<std::shared_ptr<Particle>
     return true;
 }
 
+// Test 9: Verify swept query
+bool verifySweptQuery(QuadTree& tree, const std::vector<std::shared_ptr<Particle>>& particles) {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<size_t> indexDist(0, particles.size() - 1);
+    NType radius = 0.05f;
+
+    for (int i = 0; i < 10; ++i) {
+        const auto& particle = particles[indexDist(gen)];
+
+        auto sweptResult = tree.sweptQuery(particle, radius);
+        std::vector<std::shared_ptr<Particle>> bruteForceResult;
+        for (const auto& other : particles) {
+            if (other != particle && particle->sweepDistance(*other) <= radius) {
+                bruteForceResult.push_back(other);
+            }
+        }
+
+        std::sort(sweptResult.begin(), sweptResult.end());
+        std::sort(bruteForceResult.begin(), bruteForceResult.end());
+
+        if (sweptResult != bruteForceResult) {
+            std::cout << "Swept query failed for particle " << particle->getPosition() << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Test 10: Verify batched swept collisions
+bool verifySweptCollisions(const Rect& boundary) {
+    QuadTree tree(boundary);
+    std::vector<std::shared_ptr<Particle>> particles = generateRandomParticles(2000, boundary, 5.0f);
+    tree.insert(particles);
+    NType radius = 0.5f;
+
+    // Se verifica también tras algunos pasos, con hojas ya reubicadas
+    for (int frame = 0; frame < 3; ++frame) {
+        std::vector<std::pair<Particle*, Particle*>> treeResult;
+        for (const auto& collision : tree.sweptCollisions(radius)) {
+            treeResult.emplace_back(collision.first.get(), collision.second.get());
+        }
+
+        std::vector<std::pair<Particle*, Particle*>> bruteForceResult;
+        for (size_t i = 0; i < particles.size(); ++i) {
+            for (size_t j = i + 1; j < particles.size(); ++j) {
+                if (particles[i]->sweepDistance(*particles[j]) <= radius) {
+                    bruteForceResult.emplace_back(std::min(particles[i].get(), particles[j].get()),
+                                                  std::max(particles[i].get(), particles[j].get()));
+                }
+            }
+        }
+
+        std::sort(treeResult.begin(), treeResult.end());
+        std::sort(bruteForceResult.begin(), bruteForceResult.end());
+        if (treeResult != bruteForceResult) {
+            std::cout << "Frame " << frame << ": " << treeResult.size() << " pairs vs " << bruteForceResult.size() << std::endl;
+            return false;
+        }
+
+        // Velocidades que crecen sin que la partícula cambie de hoja: step() debe elevar
+        // la cota de recorrido de los ancestros
+        for (size_t i = frame; i < particles.size(); i += 50) {
+            particles[i]->setVelocity(particles[i]->getVelocity() * 8.0f);
+        }
+        tree.step(Particle::getTimeStep());
+    }
+
+    // Única partícula de su hoja que se acelera hacia una partícula estática lejana. Los
+    // cuadrantes SW y NE están subdivididos: sin elevar la cota 0 de SW, el par (SW, NE.NE)
+    // se descarta aunque los recorridos se crucen.
+    QuadTree sparse(boundary);
+    std::vector<std::shared_ptr<Particle>> pair = {std::make_shared<Particle>(Point2D(20, 20), Point2D(0, 0)),
+                                                   std::make_shared<Particle>(Point2D(95, 95), Point2D(0, 0))};
+    for (int i = 0; i < 7; ++i) {
+        pair.push_back(std::make_shared<Particle>(Point2D(1.0f + i, 1.0f + i), Point2D(0, 0)));
+        pair.push_back(std::make_shared<Particle>(Point2D(55.0f + i, 80), Point2D(0, 0)));
+    }
+    sparse.insert(pair);
+    pair[0]->setVelocity(Point2D(50, 50));
+    sparse.step(0.0f);
+    if (sparse.sweptCollisions(radius).size() != 1 || pair[0]->sweepDistance(*pair[1]) > radius) {
+        std::cout << "Accelerated particle missed: root maxSweep " << sparse.getRoot()->getMaxSweep() << std::endl;
+        return false;
+    }
+    return true;
+}
+
 // Run all tests
 bool runTesting(QuadTree& tree, const std::vector<std::shared_ptr<Particle>>& particles, const Rect& boundary) {
     bool allTestsPassed = true;
@@ -259,7 +392,7 @@ bool runTesting(QuadTree& tree, const std::vector<std::shared_ptr<Particle>>& pa
         allTestsPassed = false;
     }
 
-    if (!verifyLeafNodesBucketSize(tree.getRoot().get(), QuadTree::bucketSize)) {
+    if (!verifyLeafNodesBucketSize(tree.getRoot().get())) {
         std::cout << "Test failed: Leaf nodes exceed bucketSize." << std::endl;
         allTestsPassed = false;
     }
@@ -284,9 +417,695 @@ bool runTesting(QuadTree& tree, const std::vector<std::shared_ptr<Particle>>& pa
         allTestsPassed = false;
     }
 
+    if (!verifySweptQuery(tree, particles)) {
+        std::cout << "Test failed: Swept query did not return the expected results." << std::endl;
+        allTestsPassed = false;
+    }
+
     return allTestsPassed;
 }
 
+// Test 11: Verify batched deletion
+size_t countNodes(QuadNode* node) {
+    size_t count = 1;
+    for (const auto& child : node->getChildren()) {
+        if (child) { count += countNodes(child.get()); }
+    }
+    return count;
+}
+
+bool verifyEraseBatch(const Rect& boundary) {
+    QuadTree tree(boundary);
+    std::vector<std::shared_ptr<Particle>> particles = generateRandomParticles(20000, boundary, 5.0f);
+    tree.insert(particles);
+    size_t nodesBefore = countNodes(tree.getRoot().get());
+
+    // Mover algunas partículas sin actualizar el árbol obliga a buscarlas fuera de su hoja
+    for (size_t i = 0; i < 100; ++i) {
+        particles[i]->updatePosition(boundary);
+    }
+
+    size_t half = particles.size() / 2;
+    std::vector<std::shared_ptr<Particle>> despawned(particles.begin(), particles.begin() + half);
+    std::vector<std::shared_ptr<Particle>> remaining(particles.begin() + half, particles.end());
+
+    if (tree.eraseBatch(despawned) != despawned.size()) {
+        std::cout << "Not all particles were erased." << std::endl;
+        return false;
+    }
+    if (tree.erase(despawned.front())) {
+        std::cout << "Erased a particle that is no longer indexed." << std::endl;
+        return false;
+    }
+    if (countNodes(tree.getRoot().get()) >= nodesBefore) {
+        std::cout << "Empty nodes were not collapsed." << std::endl;
+        return false;
+    }
+    if (!runTesting(tree, remaining, boundary)) {
+        return false;
+    }
+
+    tree.eraseBatch(remaining);
+    if (!tree.getRoot()->isLeaf() || !tree.getRoot()->getParticles().empty()) {
+        return false;
+    }
+
+    // Despawn a mitad de frame: todas las partículas se movieron desde la última
+    // actualización y aun así cada erase() desciende directo a su hoja
+    QuadTree moving(boundary);
+    std::vector<std::shared_ptr<Particle>> crowd = generateRandomParticles(200000, boundary, 5.0f);
+    moving.insert(crowd);
+    for (auto& particle : crowd) {
+        particle->updatePosition(boundary);
+    }
+    std::vector<std::shared_ptr<Particle>> burst(crowd.begin(), crowd.begin() + 2000);
+    auto start = std::chrono::steady_clock::now();
+    size_t erased = moving.eraseBatch(burst);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Erased " << erased << " moved particles out of " << crowd.size() << " in " << elapsed.count() << " s" << std::endl;
+    if (erased != burst.size()) {
+        return false;
+    }
+
+    moving.updateTree();
+    std::vector<std::shared_ptr<Particle>> survivors(crowd.begin() + 2000, crowd.end());
+    return verifyAllDataIndexed(moving.getRoot().get(), {survivors.begin(), survivors.end()}) &&
+           verifyParticlesInCorrectLeaf(moving.getRoot().get());
+}
+
+// Test 12: Verify dynamic root growth and shrink
+bool verifyRootGrowth(const Rect& boundary) {
+    QuadTree tree(boundary);
+    Rect openDomain(Point2D(-250, -250), Point2D(350, 350));
+    std::vector<std::shared_ptr<Particle>> particles = generateRandomParticles(20000, openDomain, 5.0f);
+    tree.insert(particles);
+
+    if (!tree.getDomain().isWithin(tree.getRoot()->getBoundary()) || !openDomain.isWithin(tree.getRoot()->getBoundary())) {
+        std::cout << "Root did not grow to cover all particles: " << tree.getRoot()->getBoundary() << std::endl;
+        return false;
+    }
+    if (!runTesting(tree, particles, openDomain)) {
+        return false;
+    }
+
+    // Las partículas que salen de la raíz durante la actualización tampoco se pierden
+    Rect widerDomain(Point2D(-1000, -1000), Point2D(1000, 1000));
+    for (auto& particle : particles) {
+        particle->setPosition(particle->getPosition() * NType(2.5f));
+    }
+    tree.updateTree();
+    if (!runTesting(tree, particles, widerDomain)) {
+        return false;
+    }
+
+    // Al contraerse el contenido, la raíz vuelve al dominio inicial
+    std::vector<std::shared_ptr<Particle>> outside, inside;
+    for (const auto& particle : particles) {
+        (boundary.contains(particle->getPosition()) ? inside : outside).push_back(particle);
+    }
+    tree.eraseBatch(outside);
+    tree.setAutoShrink(true);
+    tree.updateTree();
+    if (tree.getRoot()->getBoundary() != boundary) {
+        std::cout << "Root did not shrink back to the domain: " << tree.getRoot()->getBoundary() << std::endl;
+        return false;
+    }
+    if (!runTesting(tree, inside, boundary)) {
+        return false;
+    }
+
+    // Un punto muy lejano agrega unos 20 niveles sobre la raíz; maxDepth se mide desde el
+    // dominio inicial, así que el contenido original sigue subdividiéndose con normalidad
+    QuadTree populated(boundary);
+    std::vector<std::shared_ptr<Particle>> dense = generateRandomParticles(20000, boundary, 5.0f);
+    populated.insert(dense);
+    auto outlier = std::make_shared<Particle>(Point2D(1e8f, 1e8f), Point2D(0, 0));
+    populated.insert(outlier);
+    std::vector<std::shared_ptr<Particle>> more = generateRandomParticles(20000, boundary, 5.0f);
+    populated.insert(more);
+
+    size_t largestBucket = 0;
+    std::function<void(const QuadNode*)> visit = [&](const QuadNode* node) {
+        if (node->isLeaf()) {
+            if (!node->isCoincident()) { largestBucket = std::max(largestBucket, node->getParticles().size()); }
+            return;
+        }
+        for (const auto& child : node->getChildren()) { visit(child.get()); }
+    };
+    visit(populated.getRoot().get());
+    if (largestBucket > QuadTree::bucketSize) {
+        std::cout << "Root growth blocked subdivision: bucket of " << largestBucket << " particles" << std::endl;
+        return false;
+    }
+    more.insert(more.end(), dense.begin(), dense.end());
+    more.push_back(outlier);
+    return verifyAllDataIndexed(populated.getRoot().get(), {more.begin(), more.end()}) &&
+           verifyParticlesInCorrectLeaf(populated.getRoot().get());
+}
+
+// Benchmark: consultas k-NN por segundo
+double benchmarkKnn(QuadTree& tree, const Rect& boundary, int numQueries, size_t k) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> posDistX(boundary.getPmin().getX().getValue(), boundary.getPmax().getX().getValue());
+    std::uniform_real_distribution<float> posDistY(boundary.getPmin().getY().getValue(), boundary.getPmax().getY().getValue());
+
+    auto start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (int i = 0; i < numQueries; ++i) {
+        Point2D queryPoint(NType(posDistX(gen)), NType(posDistY(gen)));
+        found += tree.knn(queryPoint, k).size();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return found > 0 ? numQueries / elapsed.count() : 0.0;
+}
+
+// Benchmark: consultas de rango por segundo
+double benchmarkRange(QuadTree& tree, const Rect& boundary, int numQueries, NType size) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> posDistX(boundary.getPmin().getX().getValue(), (boundary.getPmax().getX() - size).getValue());
+    std::uniform_real_distribution<float> posDistY(boundary.getPmin().getY().getValue(), (boundary.getPmax().getY() - size).getValue());
+
+    auto start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (int i = 0; i < numQueries; ++i) {
+        Point2D corner(NType(posDistX(gen)), NType(posDistY(gen)));
+        found += tree.rangeQuery(Rect(corner, corner + Point2D(size, size))).size();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return found > 0 ? numQueries / elapsed.count() : 0.0;
+}
+
+// Benchmark: throughput de k-NN y de rango a lo largo de una simulación, antes y después
+// de compact(). Árbol nuevo con inserción en orden aleatorio, como en una simulación de larga duración
+void benchmarkCompaction(const Rect& boundary, int numParticles, int frames) {
+    std::vector<std::shared_ptr<Particle>> particles = generateRandomParticles(numParticles, boundary, 5.0f);
+    QuadTree tree(boundary);
+    tree.insert(particles);
+
+    for (int frame = 0; frame < frames; ++frame) {
+        for (auto& particle : particles) {
+            particle->updatePosition(boundary);
+        }
+        tree.updateTree();
+    }
+
+    std::cout << "Fragmentation after " << frames << " frames: " << tree.fragmentation() << std::endl;
+    double before = benchmarkKnn(tree, boundary, 20000, 8);
+    std::cout << "k-NN throughput before compact(): " << before << " queries/s" << std::endl;
+    double rangeBefore = benchmarkRange(tree, boundary, 1000, 2);
+    std::cout << "Range throughput before compact(): " << rangeBefore << " queries/s" << std::endl;
+
+    tree.compact();
+
+    std::cout << "Fragmentation after compact(): " << tree.fragmentation() << std::endl;
+    double after = benchmarkKnn(tree, boundary, 20000, 8);
+    std::cout << "k-NN throughput after compact():  " << after << " queries/s" << std::endl;
+    double rangeAfter = benchmarkRange(tree, boundary, 1000, 2);
+    std::cout << "Range throughput after compact():  " << rangeAfter << " queries/s" << std::endl;
+}
+
+// Test: compact() reordena solo la copia del árbol; los handles no cambian de partícula
+bool verifyCompaction(QuadTree& tree, const std::vector<std::shared_ptr<Particle>>& particles, const Rect& boundary) {
+    std::vector<Particle> before;
+    for (const auto& particle : particles) { before.push_back(*particle); }
+    std::vector<std::shared_ptr<Particle>> knnBefore = tree.knn(Point2D(37, 61), 20);
+
+    tree.compact();
+
+    for (size_t i = 0; i < particles.size(); ++i) {
+        if (particles[i]->getPosition() != before[i].getPosition() || particles[i]->getVelocity() != before[i].getVelocity()) {
+            std::cout << "compact() modified particle " << i << std::endl;
+            return false;
+        }
+    }
+    if (tree.knn(Point2D(37, 61), 20) != knnBefore) {
+        std::cout << "compact() changed k-NN results" << std::endl;
+        return false;
+    }
+    if (tree.fragmentation() != 0.0f) {
+        std::cout << "Fragmentation after compact(): " << tree.fragmentation() << std::endl;
+        return false;
+    }
+
+    // Cada bucket queda en un rango consecutivo de la copia propia
+    size_t expected = 0;
+    std::vector<const QuadNode*> leaves;
+    std::function<void(const QuadNode*)> collect = [&](const QuadNode* node) {
+        if (node->isLeaf()) { leaves.push_back(node); return; }
+        for (const auto& child : node->getChildren()) { collect(child.get()); }
+    };
+    collect(tree.getRoot().get());
+    for (const auto& leaf : leaves) {
+        for (size_t i = 0; i < leaf->getSlots().size(); ++i) {
+            if (leaf->getSlots()[i] != expected++ ||
+                tree.getStorage()[leaf->getSlots()[i]].getPosition() != leaf->getParticles()[i]->getPosition()) {
+                std::cout << "Storage is not in leaf order after compact()" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return runTesting(tree, particles, boundary);
+}
+
+// Test 13: Verify depth stays bounded with duplicate-heavy data
+size_t maxTreeDepth(QuadNode* node) {
+    size_t depth = 0;
+    for (const auto& child : node->getChildren()) {
+        if (child) { depth = std::max(depth, 1 + maxTreeDepth(child.get())); }
+    }
+    return depth;
+}
+
+bool verifyDuplicateHeavy(const Rect& boundary) {
+    QuadTree tree(boundary);
+    std::vector<std::shared_ptr<Particle>> particles = generateDuplicateParticles(20000, 10, boundary, 5.0f);
+    tree.insert(particles);
+
+    // Los grupos de duplicados quedan en un bucket de desbordamiento en cuanto llenan
+    // una hoja: la profundidad depende de la separación entre posiciones distintas.
+    size_t depth = maxTreeDepth(tree.getRoot().get());
+    std::cout << "Duplicate-heavy tree depth: " << depth << " (maxDepth " << QuadTree::maxDepth << ")" << std::endl;
+    if (depth > QuadTree::maxDepth / 2) {
+        return false;
+    }
+
+    if (!verifyAllDataIndexed(tree.getRoot().get(), {particles.begin(), particles.end()}) ||
+        !verifyLeafNodesBucketSize(tree.getRoot().get()) ||
+        !verifyParticlesInCorrectLeaf(tree.getRoot().get())) {
+        return false;
+    }
+
+    // Con duplicados hay empates, así que se comparan distancias y no punteros
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<float> posDist(boundary.getPmin().getX().getValue(), boundary.getPmax().getX().getValue());
+    for (int i = 0; i < 10; ++i) {
+        Point2D queryPoint(NType(posDist(gen)), NType(posDist(gen)));
+        size_t k = 50;
+
+        std::vector<float> knnDistances, bruteForceDistances;
+        for (const auto& particle : tree.knn(queryPoint, k)) {
+            knnDistances.push_back(queryPoint.distance(particle->getPosition()).getValue());
+        }
+        for (const auto& particle : particles) {
+            bruteForceDistances.push_back(queryPoint.distance(particle->getPosition()).getValue());
+        }
+        std::partial_sort(bruteForceDistances.begin(), bruteForceDistances.begin() + k, bruteForceDistances.end());
+        bruteForceDistances.resize(k);
+        std::sort(knnDistances.begin(), knnDistances.end());
+
+        if (knnDistances != bruteForceDistances) {
+            std::cout << "k-NN search failed on duplicates for query point " << queryPoint << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "Duplicate-heavy k-NN throughput: " << benchmarkKnn(tree, boundary, 2000, 8) << " queries/s" << std::endl;
+    return true;
+}
+
+// Test 14: Verify fused step against updatePosition + updateTree
+bool verifyStep(const Rect& boundary) {
+    std::vector<std::shared_ptr<Particle>> particles = generateRandomParticles(50000, boundary, 5.0f);
+    std::vector<std::shared_ptr<Particle>> copies;
+    for (const auto& particle : particles) {
+        copies.push_back(std::make_shared<Particle>(*particle));
+    }
+
+    QuadTree twoPassTree(boundary), fusedTree(boundary);
+    twoPassTree.insert(particles);
+    fusedTree.insert(copies);
+
+    std::chrono::duration<double> twoPassTime(0), fusedTime(0);
+    for (int frame = 0; frame < 5; ++frame) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto& particle : particles) {
+            particle->updatePosition(boundary);
+        }
+        twoPassTree.updateTree();
+        twoPassTime += std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        fusedTree.step(Particle::getTimeStep());
+        fusedTime += std::chrono::steady_clock::now() - start;
+    }
+    std::cout << "updatePosition + updateTree: " << twoPassTime.count() << " s, step(): " << fusedTime.count() << " s" << std::endl;
+
+    for (size_t i = 0; i < particles.size(); ++i) {
+        if (particles[i]->getPosition() != copies[i]->getPosition()) {
+            std::cout << "Particle " << i << " diverged: " << particles[i]->getPosition() << " vs " << copies[i]->getPosition() << std::endl;
+            return false;
+        }
+    }
+
+    return runTesting(fusedTree, copies, boundary);
+}
+
+// Test 15: Verify adaptive bucket-size tuning
+bool verifyAdaptiveTuning(const Rect& boundary) {
+    QuadTree tree(boundary);
+    AdaptiveConfig config;
+    config.enabled = true;
+    tree.setAdaptive(config);
+
+    std::vector<std::shared_ptr<Particle>> particles = generateClusteredParticles(20000, 8, boundary, 1.0f);
+    tree.insert(particles);
+
+    // Consultas concentradas en la mitad inferior; el movimiento genera rotación en todo el árbol
+    std::mt19937 gen(17);
+    std::uniform_real_distribution<float> posDistX(boundary.getPmin().getX().getValue(), boundary.getPmax().getX().getValue());
+    std::uniform_real_distribution<float> posDistY(boundary.getPmin().getY().getValue(), boundary.getCenter().getY().getValue());
+    for (int frame = 0; frame < 5; ++frame) {
+        for (int i = 0; i < 500; ++i) {
+            tree.knn(Point2D(NType(posDistX(gen)), NType(posDistY(gen))), 8);
+        }
+        tree.step(Particle::getTimeStep());
+    }
+
+    TuningReport report = tree.getTuningReport();
+    std::cout << "Adaptive tuning: " << report << std::endl;
+    if (report.minCapacity < config.minBucket || report.maxCapacity > config.maxBucket || report.minCapacity == report.maxCapacity) {
+        return false;
+    }
+    if (!runTesting(tree, particles, boundary)) {
+        return false;
+    }
+
+    // Sin k-NN: las consultas de rango y de colisiones también cuentan como costo de
+    // consulta, así que las hojas consultadas se achican en lugar de solo crecer
+    std::vector<std::function<void(QuadTree&)>> workloads = {
+        [&](QuadTree& queried) {
+            for (int i = 0; i < 500; ++i) {
+                Point2D corner(NType(posDistX(gen)), NType(posDistY(gen)));
+                queried.rangeQuery(Rect(corner, corner + Point2D(2, 2)));
+            }
+        },
+        [&](QuadTree& queried) { queried.sweptCollisions(0.5f); },
+    };
+    for (const auto& workload : workloads) {
+        QuadTree queried(boundary);
+        queried.setAdaptive(config);
+        std::vector<std::shared_ptr<Particle>> still = generateClusteredParticles(20000, 8, boundary, 0.0f);
+        queried.insert(still);
+        for (int frame = 0; frame < 5; ++frame) {
+            workload(queried);
+            queried.step(Particle::getTimeStep());
+        }
+        TuningReport queriedReport = queried.getTuningReport();
+        std::cout << "Adaptive tuning without k-NN: " << queriedReport << std::endl;
+        if (queriedReport.minCapacity >= QuadTree::bucketSize) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Test 16: Verify compact quantized index against the pointer tree
+bool verifyCompactIndex(QuadTree& tree, const std::vector<std::shared_ptr<Particle>>& particles, const Rect& boundary) {
+    // Los handles se mueven sin actualizar el árbol: el índice debe seguir a la copia
+    // del árbol, igual que QuadTree::knn()
+    for (auto& particle : particles) {
+        particle->updatePosition(boundary);
+    }
+    CompactIndex index(tree);
+
+    std::mt19937 gen(19);
+    std::uniform_real_distribution<float> posDistX(boundary.getPmin().getX().getValue(), boundary.getPmax().getX().getValue());
+    std::uniform_real_distribution<float> posDistY(boundary.getPmin().getY().getValue(), boundary.getPmax().getY().getValue());
+    std::vector<Point2D> queries;
+    for (int i = 0; i < 2000; ++i) {
+        queries.emplace_back(NType(posDistX(gen)), NType(posDistY(gen)));
+    }
+
+    for (size_t i = 0; i < 200; ++i) {
+        auto treeResult = tree.knn(queries[i], 8);
+        auto compactResult = index.knn(queries[i], 8);
+        std::sort(treeResult.begin(), treeResult.end());
+        std::sort(compactResult.begin(), compactResult.end());
+        if (treeResult != compactResult) {
+            std::cout << "Compact k-NN differs for query point " << queries[i] << std::endl;
+            return false;
+        }
+    }
+
+    // Huella por partícula. El índice no reemplaza al árbol (lee su copia), así que se
+    // reporta también la suma de ambos.
+    size_t treeBytes = particles.size() * (sizeof(std::shared_ptr<Particle>) + sizeof(uint32_t)) +
+                       countNodes(tree.getRoot().get()) * sizeof(QuadNode) + tree.getStorage().size() * sizeof(Particle);
+    std::cout << "Pointer tree:  " << static_cast<double>(treeBytes) / particles.size()
+              << " bytes/particle (buckets, slots, nodes, own copy)" << std::endl;
+    std::cout << "Compact index: " << static_cast<double>(index.indexBytes()) / particles.size() << " bytes/particle on top of the tree, "
+              << static_cast<double>(treeBytes + index.indexBytes()) / particles.size() << " combined" << std::endl;
+    if (index.indexBytes() < particles.size() * (sizeof(CompactIndex::Entry) + sizeof(std::shared_ptr<Particle>))) {
+        std::cout << "Compact index undercounts its slot table" << std::endl;
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& query : queries) { tree.knn(query, 8); }
+    std::chrono::duration<double> treeTime = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (const auto& query : queries) { index.knn(query, 8); }
+    std::chrono::duration<double> compactTime = std::chrono::steady_clock::now() - start;
+    std::cout << "k-NN throughput pointer tree: " << queries.size() / treeTime.count() << " queries/s, compact: "
+              << queries.size() / compactTime.count() << " queries/s" << std::endl;
+
+    // El árbol vuelve a reflejar los handles para las pruebas siguientes (invalida el índice)
+    tree.updateTree();
+    return true;
+}
+
+// Test 17: Verify all-points k-NN graph
+bool verifyKnnGraph(const Rect& boundary) {
+    QuadTree tree(boundary);
+    std::vector<std::shared_ptr<Particle>> particles = generateRandomParticles(10000, boundary, 5.0f);
+    tree.insert(particles);
+    size_t k = 8;
+
+    auto start = std::chrono::steady_clock::now();
+    KnnGraph graph = tree.knnGraph(k);
+    std::chrono::duration<double> graphTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    std::vector<std::vector<std::shared_ptr<Particle>>> repeated;
+    for (const auto& particle : graph.particles) {
+        repeated.push_back(tree.knn(particle->getPosition(), k + 1));
+    }
+    std::chrono::duration<double> repeatedTime = std::chrono::steady_clock::now() - start;
+    std::cout << "knnGraph(): " << graphTime.count() << " s, repeated knn(): " << repeatedTime.count() << " s" << std::endl;
+
+    if (graph.particles.size() != particles.size() || graph.offsets.back() != graph.neighbors.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < graph.particles.size(); ++i) {
+        Point2D position = graph.particles[i]->getPosition();
+        std::vector<NType> graphDistances, knnDistances;
+        for (size_t j = graph.offsets[i]; j < graph.offsets[i + 1]; ++j) {
+            graphDistances.push_back(position.distance(graph.particles[graph.neighbors[j]]->getPosition()));
+        }
+        for (const auto& neighbor : repeated[i]) {
+            if (neighbor != graph.particles[i]) { knnDistances.push_back(position.distance(neighbor->getPosition())); }
+        }
+        knnDistances.resize(k);
+
+        // Comparación con el epsilon de Safe: los empates pueden resolverse distinto
+        for (size_t j = 0; j < k; ++j) {
+            if (graphDistances[j] != knnDistances[j]) {
+                std::cout << "k-NN graph row " << i << " differs from knn() at neighbor " << j << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void collectVersionNodes(const VersionNode* node, std::set<const VersionNode*>& nodes) {
+    nodes.insert(node);
+    for (const auto& child : node->children) {
+        if (child) { collectVersionNodes(child.get(), nodes); }
+    }
+}
+
+// Test 18: Verify persistent tree versions
+bool verifyVersions(const Rect& boundary) {
+    QuadTree tree(boundary);
+    std::vector<std::shared_ptr<Particle>> particles = generateRandomParticles(20000, boundary, 5.0f);
+    tree.insert(particles);
+    tree.setVersioning(3);
+
+    // Sin versiones, cualquier consulta por antigüedad queda fuera de rango
+    auto outOfRange = [&](size_t framesAgo) {
+        try {
+            tree.getVersion(framesAgo);
+        } catch (const std::out_of_range&) {
+            return true;
+        }
+        return false;
+    };
+    if (!outOfRange(0)) {
+        std::cout << "getVersion(0) on a tree without versions did not throw" << std::endl;
+        return false;
+    }
+    tree.commitVersion();
+
+    // Posiciones esperadas de cada frame; solo se mueve el 1% de las partículas
+    std::vector<std::vector<Point2D>> history;
+    auto record = [&]() {
+        std::vector<Point2D> positions;
+        for (const auto& particle : particles) { positions.push_back(particle->getPosition()); }
+        history.push_back(positions);
+    };
+    record();
+
+    TreeVersion oldest = tree.getVersion(0);
+    for (int frame = 0; frame < 5; ++frame) {
+        for (size_t i = frame; i < particles.size(); i += 100) {
+            particles[i]->updatePosition(boundary);
+        }
+        tree.updateTree();
+        record();
+    }
+
+    if (tree.getVersions().size() != 3 || tree.getVersion(0).getFrame() != 5) {
+        std::cout << "Retention kept " << tree.getVersions().size() << " versions" << std::endl;
+        return false;
+    }
+    if (!outOfRange(3)) {
+        std::cout << "getVersion(3) past the retention window did not throw" << std::endl;
+        return false;
+    }
+
+    // El handle conservado sigue siendo consultable aunque la retención lo descartó
+    std::vector<TreeVersion> versions = {tree.getVersion(0), tree.getVersion(1), tree.getVersion(2), oldest};
+    std::vector<size_t> frames = {5, 4, 3, 0};
+    Rect range(Point2D(20, 20), Point2D(45, 60));
+    Point2D query(50, 50);
+
+    for (size_t v = 0; v < versions.size(); ++v) {
+        const std::vector<Point2D>& expected = history[frames[v]];
+
+        if (versions[v].rangeQuery(boundary).size() != particles.size()) {
+            std::cout << "Version of frame " << frames[v] << " lost particles" << std::endl;
+            return false;
+        }
+
+        size_t inRange = 0;
+        for (const auto& position : expected) { inRange += range.contains(position) ? 1 : 0; }
+        std::vector<VersionEntry> found = versions[v].rangeQuery(range);
+        if (found.size() != inRange) {
+            std::cout << "Range query on frame " << frames[v] << ": " << found.size() << " vs " << inRange << std::endl;
+            return false;
+        }
+
+        std::vector<float> distances;
+        for (const auto& position : expected) { distances.push_back(query.distance(position).getValue()); }
+        std::sort(distances.begin(), distances.end());
+        std::vector<VersionEntry> nearest = versions[v].knn(query, 10);
+        for (size_t j = 0; j < nearest.size(); ++j) {
+            if (query.distance(nearest[j].position) != distances[j]) {
+                std::cout << "knn on frame " << frames[v] << " differs at neighbor " << j << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // Frames consecutivos comparten la mayoría de los nodos
+    std::set<const VersionNode*> previous, current;
+    collectVersionNodes(tree.getVersion(1).getRoot().get(), previous);
+    collectVersionNodes(tree.getVersion(0).getRoot().get(), current);
+    size_t shared = 0;
+    for (const auto& node : current) { shared += previous.count(node); }
+    std::cout << "Version nodes: " << current.size() << ", shared with previous frame: " << shared << std::endl;
+
+    return shared > current.size() / 2;
+}
+
+// Test 19: Verify sharded multi-tree engine
+bool verifyShardedTree(const Rect& boundary) {
+    std::vector<std::shared_ptr<Particle>> particles = generateRandomParticles(50000, boundary, 5.0f);
+    std::vector<std::shared_ptr<Particle>> copies;
+    for (const auto& particle : particles) {
+        copies.push_back(std::make_shared<Particle>(*particle));
+    }
+
+    ShardedTree sharded(boundary, 4, 4);
+    QuadTree single(boundary);
+    sharded.insert(particles);
+    single.insert(copies);
+
+    // Las partículas fuera del dominio no se indexan ni se cuentan en size()
+    std::vector<std::shared_ptr<Particle>> outsiders = {
+        std::make_shared<Particle>(Point2D(150, 50), Point2D(0, 0)),
+        std::make_shared<Particle>(Point2D(-10, -10), Point2D(0, 0)),
+        std::make_shared<Particle>(Point2D(50, 1000), Point2D(0, 0)),
+    };
+    sharded.insert(outsiders);
+
+    std::chrono::duration<double> shardedTime(0), singleTime(0);
+    for (int frame = 0; frame < 5; ++frame) {
+        auto start = std::chrono::steady_clock::now();
+        sharded.step(Particle::getTimeStep());
+        shardedTime += std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        single.step(Particle::getTimeStep());
+        singleTime += std::chrono::steady_clock::now() - start;
+    }
+    std::cout << "Sharded step(): " << shardedTime.count() << " s, single tree step(): " << singleTime.count() << " s" << std::endl;
+
+    if (sharded.size() != particles.size()) {
+        std::cout << "Sharded engine holds " << sharded.size() << " of " << particles.size() << " particles" << std::endl;
+        return false;
+    }
+    std::vector<std::shared_ptr<Particle>> rejected = sharded.takeOutOfDomain();
+    if (rejected.size() != outsiders.size() || !sharded.takeOutOfDomain().empty()) {
+        std::cout << "Sharded engine reported " << rejected.size() << " of " << outsiders.size() << " particles outside the domain" << std::endl;
+        return false;
+    }
+
+    // Cada shard contiene exactamente las partículas de su celda
+    std::vector<std::set<std::shared_ptr<Particle>>> expected(sharded.getShardCount());
+    for (const auto& particle : particles) {
+        expected[sharded.shardOf(particle->getPosition())].insert(particle);
+    }
+    for (size_t i = 0; i < sharded.getShardCount(); ++i) {
+        QuadNode* root = sharded.getShard(i).tree->getRoot().get();
+        if (!verifyAllDataIndexed(root, expected[i]) || !verifyParticlesInCorrectLeaf(root)) {
+            std::cout << "Shard " << i << " is inconsistent" << std::endl;
+            return false;
+        }
+    }
+
+    // Consultas cerca de las esquinas de los shards cruzan a los vecinos
+    std::vector<Point2D> queries = {Point2D(25, 25), Point2D(50, 50.5f), Point2D(74.9f, 10), Point2D(3, 97)};
+    for (int i = 0; i < 20; ++i) {
+        queries.push_back(Point2D(static_cast<float>(rand() % 100), static_cast<float>(rand() % 100)));
+    }
+    for (const auto& query : queries) {
+        std::vector<std::shared_ptr<Particle>> shardedResult = sharded.knn(query, 20);
+        std::vector<std::shared_ptr<Particle>> singleResult = single.knn(query, 20);
+        if (shardedResult.size() != singleResult.size()) { return false; }
+        for (size_t j = 0; j < shardedResult.size(); ++j) {
+            if (query.distance(shardedResult[j]->getPosition()) != query.distance(singleResult[j]->getPosition())) {
+                std::cout << "Sharded knn differs at " << query << ", neighbor " << j << std::endl;
+                return false;
+            }
+        }
+
+        Rect range(query - Point2D(8, 8), query + Point2D(8, 8));
+        if (sharded.rangeQuery(range).size() != single.rangeQuery(range).size()) {
+            std::cout << "Sharded range query differs at " << query << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
 int main() {
     Rect boundary(Point2D(0, 0), Point2D(100, 100));
     QuadTree tree(boundary);
@@ -317,6 +1136,97 @@ int main() {
     } else {
         std::cout << "Some tests failed." << std::endl;
     }
-    
+
+    // Índice compacto con coordenadas cuantizadas
+    std::cout << std::endl << "Testing compact quantized index..." << std::endl;
+    if (verifyCompactIndex(tree, particles, boundary)) {
+        std::cout << "All tests passed!" << std::endl;
+    } else {
+        std::cout << "Test failed: Compact index k-NN differs from the pointer tree." << std::endl;
+    }
+
+    // Colisiones continuas de todas las partículas en una sola pasada
+    std::cout << std::endl << "Testing swept collisions..." << std::endl;
+    if (verifySweptCollisions(boundary)) {
+        std::cout << "All tests passed!" << std::endl;
+    } else {
+        std::cout << "Test failed: Swept collisions did not match brute force." << std::endl;
+    }
+
+    // Eliminación masiva con colapso diferido
+    std::cout << std::endl << "Testing batched deletion..." << std::endl;
+    if (verifyEraseBatch(boundary)) {
+        std::cout << "All tests passed!" << std::endl;
+    } else {
+        std::cout << "Test failed: Batched deletion left the tree inconsistent." << std::endl;
+    }
+
+    // Crecimiento dinámico de la raíz
+    std::cout << std::endl << "Testing dynamic root growth..." << std::endl;
+    if (verifyRootGrowth(boundary)) {
+        std::cout << "All tests passed!" << std::endl;
+    } else {
+        std::cout << "Test failed: Root growth lost particles or left the tree inconsistent." << std::endl;
+    }
+
+    // Grafo k-NN de todas las partículas
+    std::cout << std::endl << "Testing k-NN graph..." << std::endl;
+    if (verifyKnnGraph(boundary)) {
+        std::cout << "All tests passed!" << std::endl;
+    } else {
+        std::cout << "Test failed: k-NN graph differs from repeated knn() queries." << std::endl;
+    }
+
+    // Paso de simulación fusionado
+    std::cout << std::endl << "Testing fused simulation step..." << std::endl;
+    if (verifyStep(boundary)) {
+        std::cout << "All tests passed!" << std::endl;
+    } else {
+        std::cout << "Test failed: step() diverged from updatePosition + updateTree." << std::endl;
+    }
+
+    // Ajuste adaptativo de capacidades
+    std::cout << std::endl << "Testing adaptive bucket-size tuning..." << std::endl;
+    if (verifyAdaptiveTuning(boundary)) {
+        std::cout << "All tests passed!" << std::endl;
+    } else {
+        std::cout << "Test failed: Adaptive tuning produced invalid capacities or an inconsistent tree." << std::endl;
+    }
+
+    // Datos con muchas posiciones duplicadas
+    std::cout << std::endl << "Testing duplicate-heavy data..." << std::endl;
+    if (verifyDuplicateHeavy(boundary)) {
+        std::cout << "All tests passed!" << std::endl;
+    } else {
+        std::cout << "Test failed: Duplicate-heavy data produced an unbounded or inconsistent tree." << std::endl;
+    }
+
+    // Versiones persistentes por frame
+    std::cout << std::endl << "Testing persistent tree versions..." << std::endl;
+    if (verifyVersions(boundary)) {
+        std::cout << "All tests passed!" << std::endl;
+    } else {
+        std::cout << "Test failed: Persistent versions differ from the recorded frames." << std::endl;
+    }
+
+    // Motor con el dominio repartido en shards
+    std::cout << std::endl << "Testing sharded multi-tree engine..." << std::endl;
+    if (verifyShardedTree(boundary)) {
+        std::cout << "All tests passed!" << std::endl;
+    } else {
+        std::cout << "Test failed: Sharded engine differs from a single QuadTree." << std::endl;
+    }
+
+    // Reordenar la memoria y verificar que el árbol sigue siendo consistente
+    std::cout << std::endl << "Compacting particle memory..." << std::endl;
+    if (verifyCompaction(tree, particles, boundary)) {
+        std::cout << "All tests passed!" << std::endl;
+    } else {
+        std::cout << "Test failed: compact() changed the particles behind the caller's handles." << std::endl;
+    }
+
+    std::cout << std::endl << "Benchmarking compaction..." << std::endl;
+    benchmarkCompaction(boundary, 1000000, 5);
+
     return 0;
 }
@@ -0,0 +1,169 @@
+// Generador de carga para quadtree_server: abre varias conexiones, envía lotes
+// de consultas k-NN y de rango y mide el tiempo de ida y vuelta de cada lote.
+// Antes de medir comprueba que el servidor rechaza una consulta de kind desconocido.
+//
+// Uso: quadtree_load [socketPath] [connections] [batchesPerConnection] [batchSize] [k]
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "Protocol.h"
+
+struct ConnectionStats {
+    std::vector<double> latencies; // microsegundos por lote
+    size_t queries = 0, hits = 0;
+    bool ok = true;
+};
+
+static int connectTo(const std::string& socketPath) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        if (fd >= 0) { ::close(fd); }
+        return -1;
+    }
+    return fd;
+}
+
+// 80% k-NN y 20% rangos de 4x4 en el dominio [0, 100]^2 del servidor
+static void runConnection(const std::string& socketPath, size_t numBatches, size_t batchSize, uint16_t k, unsigned seed, ConnectionStats& stats) {
+    int fd = connectTo(socketPath);
+    if (fd < 0) {
+        std::perror("quadtree_load");
+        stats.ok = false;
+        return;
+    }
+
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> posDist(0.0f, 96.0f);
+    std::uniform_int_distribution<int> kindDist(0, 4);
+    std::vector<char> message, payload;
+    uint32_t nextId = 0;
+
+    for (size_t b = 0; b < numBatches; ++b) {
+        message.assign(sizeof(uint32_t), 0);
+        protocol::append(message, static_cast<uint32_t>(batchSize));
+        uint32_t firstId = nextId;
+        for (size_t i = 0; i < batchSize; ++i) {
+            float x = posDist(gen), y = posDist(gen);
+            protocol::Request request{nextId++, protocol::Knn, k, x, y, 0, 0};
+            if (kindDist(gen) == 0) { request = {request.id, protocol::Range, 0, x, y, x + 4, y + 4}; }
+            protocol::append(message, request);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if (!protocol::writeMessage(fd, message) || !protocol::readMessage(fd, payload)) {
+            std::cerr << "Connection closed by server" << std::endl;
+            stats.ok = false;
+            break;
+        }
+        stats.latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+
+        // Las respuestas llegan en el orden de las consultas
+        size_t offset = 0;
+        uint32_t count = 0;
+        bool valid = protocol::extract(payload, offset, count) && count == batchSize;
+        for (uint32_t i = 0; valid && i < count; ++i) {
+            protocol::ResponseHeader header;
+            valid = protocol::extract(payload, offset, header) && header.id == firstId + i && header.status == protocol::Ok;
+            offset += valid ? header.count * sizeof(protocol::Hit) : 0;
+            valid = valid && offset <= payload.size();
+            stats.hits += valid ? header.count : 0;
+        }
+        if (!valid || offset != payload.size()) {
+            std::cerr << "Malformed response" << std::endl;
+            stats.ok = false;
+            break;
+        }
+        stats.queries += batchSize;
+    }
+
+    ::close(fd);
+}
+
+// Un lote con una consulta válida y otra de kind desconocido: la segunda debe
+// volver con status UnknownKind y sin resultados, y la primera no verse afectada
+static bool checkUnknownKind(const std::string& socketPath) {
+    int fd = connectTo(socketPath);
+    if (fd < 0) {
+        std::perror("quadtree_load");
+        return false;
+    }
+
+    std::vector<char> message(sizeof(uint32_t)), payload;
+    protocol::append(message, static_cast<uint32_t>(2));
+    protocol::append(message, protocol::Request{0, protocol::Knn, 4, 50, 50, 0, 0});
+    protocol::append(message, protocol::Request{1, 7, 4, 50, 50, 0, 0});
+    bool ok = protocol::writeMessage(fd, message) && protocol::readMessage(fd, payload);
+
+    size_t offset = 0;
+    uint32_t count = 0;
+    protocol::ResponseHeader knn{}, unknown{};
+    ok = ok && protocol::extract(payload, offset, count) && count == 2 && protocol::extract(payload, offset, knn)
+         && knn.status == protocol::Ok && knn.count == 4;
+    offset += ok ? knn.count * sizeof(protocol::Hit) : 0;
+    ok = ok && protocol::extract(payload, offset, unknown) && unknown.id == 1
+         && unknown.status == protocol::UnknownKind && unknown.count == 0 && offset == payload.size();
+
+    ::close(fd);
+    return ok;
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) { return 0; }
+    size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, char* argv[]) {
+    std::string socketPath = argc > 1 ? argv[1] : protocol::defaultSocketPath;
+    size_t connections = argc > 2 ? std::stoul(argv[2]) : 4;
+    size_t numBatches = argc > 3 ? std::stoul(argv[3]) : 1000;
+    size_t batchSize = argc > 4 ? std::stoul(argv[4]) : 32;
+    uint16_t k = static_cast<uint16_t>(argc > 5 ? std::stoul(argv[5]) : 8);
+
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (!checkUnknownKind(socketPath)) {
+        std::cerr << "Server did not reject an unknown query kind" << std::endl;
+        return 1;
+    }
+
+    std::vector<ConnectionStats> stats(connections);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < connections; ++c) {
+        threads.emplace_back(runConnection, socketPath, numBatches, batchSize, k, static_cast<unsigned>(c + 1), std::ref(stats[c]));
+    }
+    for (auto& thread : threads) { thread.join(); }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::vector<double> latencies;
+    size_t queries = 0, hits = 0;
+    bool ok = true;
+    for (const auto& connection : stats) {
+        latencies.insert(latencies.end(), connection.latencies.begin(), connection.latencies.end());
+        queries += connection.queries;
+        hits += connection.hits;
+        ok = ok && connection.ok;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << "Connections: " << connections << ", batches: " << latencies.size() << ", batch size: " << batchSize << std::endl;
+    std::cout << "Batch latency p50: " << percentile(latencies, 0.50) << " us, p99: " << percentile(latencies, 0.99) << " us" << std::endl;
+    std::cout << "Throughput: " << static_cast<double>(queries) / elapsed.count() << " queries/s ("
+              << static_cast<double>(hits) / std::max<size_t>(queries, 1) << " hits per query)" << std::endl;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+// Protocolo binario entre quadtree_server y sus clientes (mismo host, orden de bytes nativo).
+//
+// Cada mensaje es un uint32 con la longitud del payload seguido del payload:
+//   cliente -> servidor: uint32 count, count x Request
+//   servidor -> cliente: uint32 count, count x (ResponseHeader, header.count x Hit)
+// Las respuestas de un lote llegan en un solo mensaje y en el orden de las consultas.
+// Una consulta rechazada (p. ej. kind desconocido) responde con status != Ok y count 0.
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+namespace protocol {
+
+constexpr const char* defaultSocketPath = "/tmp/quadtree.sock";
+constexpr uint32_t maxMessageBytes = 64u << 20;
+
+enum Kind : uint16_t { Knn = 1, Range = 2 };
+
+enum Status : uint16_t { Ok = 0, UnknownKind = 1 };
+
+// Knn: (x0, y0) y k. Range: [x0, x1] x [y0, y1].
+struct Request {
+    uint32_t id;
+    uint16_t kind;
+    uint16_t k;
+    float x0, y0, x1, y1;
+};
+
+struct ResponseHeader {
+    uint32_t id;
+    uint16_t status;
+    uint16_t reserved;
+    uint32_t count;
+};
+
+// Índice de la partícula en el servidor y su posición en el frame consultado
+struct Hit {
+    uint32_t particle;
+    float x, y;
+};
+
+static_assert(sizeof(Request) == 24, "Request debe ocupar 24 bytes");
+static_assert(sizeof(ResponseHeader) == 12, "ResponseHeader debe ocupar 12 bytes");
+static_assert(sizeof(Hit) == 12, "Hit debe ocupar 12 bytes");
+
+inline bool readFully(int fd, void* data, size_t size) {
+    char* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = ::read(fd, bytes, size);
+        if (n <= 0) { return false; }
+        bytes += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+inline bool writeFully(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::write(fd, bytes, size);
+        if (n <= 0) { return false; }
+        bytes += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+inline bool readMessage(int fd, std::vector<char>& payload) {
+    uint32_t size = 0;
+    if (!readFully(fd, &size, sizeof(size)) || size > maxMessageBytes) { return false; }
+    payload.resize(size);
+    return readFully(fd, payload.data(), size);
+}
+
+// 'message' empieza con 4 bytes reservados para la longitud, que se completa
+// aquí para escribir prefijo y payload en una sola llamada
+inline bool writeMessage(int fd, std::vector<char>& message) {
+    uint32_t size = static_cast<uint32_t>(message.size() - sizeof(uint32_t));
+    std::memcpy(message.data(), &size, sizeof(size));
+    return writeFully(fd, message.data(), message.size());
+}
+
+// Agrega un valor trivial al final del buffer
+template <typename T>
+void append(std::vector<char>& buffer, const T& value) {
+    size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(T));
+    std::memcpy(buffer.data() + offset, &value, sizeof(T));
+}
+
+// Lee un valor trivial en 'offset' y avanza; false si el buffer es demasiado corto
+template <typename T>
+bool extract(const std::vector<char>& buffer, size_t& offset, T& value) {
+    if (offset + sizeof(T) > buffer.size()) { return false; }
+    std::memcpy(&value, buffer.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+} // namespace protocol
+
+#endif // PROTOCOL_H
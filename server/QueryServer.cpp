@@ -0,0 +1,322 @@
+// Servidor local de consultas: es dueño del QuadTree, avanza la simulación a
+// intervalos fijos y atiende lotes de k-NN y rango por un socket Unix. Las
+// consultas se resuelven sobre la última TreeVersion publicada, así que se
+// siguen atendiendo mientras el árbol vivo se actualiza. Los lotes de todas
+// las conexiones que llegan juntos se agrupan en una sola pasada paralela sobre
+// un pool de hilos persistente.
+// Cada conexión tiene su propio hilo escritor y un límite de lotes sin responder:
+// un cliente que no lee sus respuestas se desconecta sin frenar a los demás.
+//
+// Uso: quadtree_server [socketPath] [numParticles] [frameMs]
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+#include <csignal>
+#include <cstdio>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../QuadTree.h"
+#include "../Parallel.h"
+#include "Protocol.h"
+
+static std::atomic<bool> stopRequested(false);
+
+static void requestStop(int) { stopRequested = true; }
+
+// Lotes recibidos y aún sin respuesta escrita a partir de los cuales el cliente
+// se considera atrasado
+constexpr size_t maxOutstandingBatches = 64;
+
+struct Connection {
+    int fd;
+    std::atomic<bool> closed{false}; // el hilo lector terminó
+    std::atomic<size_t> outstanding{0};
+
+    std::mutex outboxMutex;
+    std::condition_variable outboxReady;
+    std::deque<std::vector<char>> outbox;
+    bool closing = false;
+
+    explicit Connection(int fd) : fd(fd) {}
+    ~Connection() { ::close(fd); }
+
+    // Encola una respuesta para el hilo escritor; se descarta si la conexión ya cerró
+    void enqueue(std::vector<char>&& message) {
+        std::lock_guard<std::mutex> lock(outboxMutex);
+        if (closing) { return; }
+        outbox.push_back(std::move(message));
+        outboxReady.notify_one();
+    }
+
+    // Despierta al lector y al escritor; las respuestas pendientes se descartan
+    void shutdown() {
+        std::lock_guard<std::mutex> lock(outboxMutex);
+        shutdownLocked();
+    }
+
+private:
+    void shutdownLocked() {
+        if (closing) { return; }
+        closing = true;
+        outbox.clear();
+        ::shutdown(fd, SHUT_RDWR);
+        outboxReady.notify_one();
+    }
+};
+
+struct PendingBatch {
+    std::shared_ptr<Connection> connection;
+    std::vector<protocol::Request> requests;
+};
+
+class QueryServer {
+private:
+    Rect boundary;
+    QuadTree tree;
+    std::vector<std::shared_ptr<Particle>> particles;
+    std::unordered_map<const Particle*, uint32_t> particleIds;
+
+    // Versión que ven las consultas; el hilo de simulación la reemplaza en cada frame
+    std::mutex versionMutex;
+    std::shared_ptr<const TreeVersion> current;
+
+    std::mutex pendingMutex;
+    std::condition_variable pendingReady;
+    std::vector<PendingBatch> pending;
+
+    // Hilos del ejecutor; persisten entre pasadas
+    WorkerPool workers;
+
+    std::chrono::milliseconds framePeriod;
+    size_t frames = 0, passes = 0, batches = 0, queries = 0, rejected = 0;
+    std::atomic<size_t> dropped{0};
+
+    std::shared_ptr<const TreeVersion> currentVersion() {
+        std::lock_guard<std::mutex> lock(versionMutex);
+        return current;
+    }
+
+public:
+    QueryServer(size_t numParticles, std::chrono::milliseconds framePeriod)
+        : boundary(Point2D(0, 0), Point2D(100, 100)), tree(boundary), framePeriod(framePeriod) {
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<float> posDist(0.0f, 100.0f), velDist(-5.0f, 5.0f);
+        for (size_t i = 0; i < numParticles; ++i) {
+            auto particle = std::make_shared<Particle>(Point2D(posDist(gen), posDist(gen)), Point2D(velDist(gen), velDist(gen)));
+            particleIds[particle.get()] = static_cast<uint32_t>(i);
+            particles.push_back(particle);
+        }
+        tree.insert(particles);
+
+        tree.setVersioning(1);
+        current = std::make_shared<TreeVersion>(tree.commitVersion());
+    }
+
+    void simulate() {
+        auto next = std::chrono::steady_clock::now();
+        while (!stopRequested) {
+            tree.step(Particle::getTimeStep());
+            {
+                std::lock_guard<std::mutex> lock(versionMutex);
+                current = std::make_shared<TreeVersion>(tree.getVersion(0));
+            }
+            frames++;
+            next += framePeriod;
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+    // Lee lotes de una conexión hasta que el cliente la cierra
+    void receive(std::shared_ptr<Connection> connection) {
+        std::vector<char> payload;
+        while (protocol::readMessage(connection->fd, payload)) {
+            size_t offset = 0;
+            uint32_t count = 0;
+            if (!protocol::extract(payload, offset, count) || payload.size() != offset + count * sizeof(protocol::Request)) {
+                std::cerr << "Malformed batch, closing connection" << std::endl;
+                break;
+            }
+
+            // El escritor de la conexión descuenta cada respuesta que logra enviar
+            if (++connection->outstanding > maxOutstandingBatches) {
+                std::cerr << "Client is not reading responses, closing connection" << std::endl;
+                dropped++;
+                break;
+            }
+
+            PendingBatch batch{connection, std::vector<protocol::Request>(count)};
+            for (auto& request : batch.requests) { protocol::extract(payload, offset, request); }
+            {
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                pending.push_back(std::move(batch));
+            }
+            pendingReady.notify_one();
+        }
+        connection->shutdown();
+        connection->closed = true;
+    }
+
+    // Escribe las respuestas encoladas de una conexión hasta que se cierra
+    void transmit(std::shared_ptr<Connection> connection) {
+        std::vector<char> message;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(connection->outboxMutex);
+                connection->outboxReady.wait(lock, [&]() { return connection->closing || !connection->outbox.empty(); });
+                if (connection->closing) { return; }
+                message.swap(connection->outbox.front());
+                connection->outbox.pop_front();
+            }
+            if (!protocol::writeMessage(connection->fd, message)) {
+                connection->shutdown();
+                return;
+            }
+            connection->outstanding--;
+        }
+    }
+
+    // Agrupa los lotes pendientes de todas las conexiones y los resuelve en una pasada
+    void execute() {
+        while (true) {
+            std::vector<PendingBatch> coalesced;
+            {
+                std::unique_lock<std::mutex> lock(pendingMutex);
+                pendingReady.wait_for(lock, std::chrono::milliseconds(100), [&]() { return !pending.empty(); });
+                if (pending.empty()) {
+                    if (stopRequested) { return; }
+                    continue;
+                }
+                coalesced.swap(pending);
+            }
+
+            std::vector<const protocol::Request*> requests;
+            for (const auto& batch : coalesced) {
+                for (const auto& request : batch.requests) { requests.push_back(&request); }
+            }
+
+            std::shared_ptr<const TreeVersion> version = currentVersion();
+            std::vector<std::vector<VersionEntry>> results(requests.size());
+            workers.parallelFor(requests.size(), [&](size_t, size_t i) {
+                const protocol::Request& request = *requests[i];
+                if (request.kind == protocol::Knn) {
+                    results[i] = version->knn(Point2D(request.x0, request.y0), request.k);
+                } else if (request.kind == protocol::Range) {
+                    results[i] = version->rangeQuery(Rect(Point2D(request.x0, request.y0), Point2D(request.x1, request.y1)));
+                }
+            }, 4);
+
+            size_t index = 0;
+            for (const auto& batch : coalesced) {
+                std::vector<char> message(sizeof(uint32_t));
+                protocol::append(message, static_cast<uint32_t>(batch.requests.size()));
+                for (const auto& request : batch.requests) {
+                    const std::vector<VersionEntry>& entries = results[index++];
+                    bool known = request.kind == protocol::Knn || request.kind == protocol::Range;
+                    uint16_t status = known ? protocol::Ok : protocol::UnknownKind;
+                    rejected += known ? 0 : 1;
+                    protocol::append(message, protocol::ResponseHeader{request.id, status, 0, static_cast<uint32_t>(entries.size())});
+                    for (const auto& entry : entries) {
+                        protocol::Hit hit{particleIds.at(entry.particle.get()), entry.position.getX().getValue(), entry.position.getY().getValue()};
+                        protocol::append(message, hit);
+                    }
+                }
+                // El hilo escritor de la conexión la envía
+                batch.connection->enqueue(std::move(message));
+            }
+
+            passes++;
+            batches += coalesced.size();
+            queries += requests.size();
+        }
+    }
+
+    void printStats() const {
+        std::cout << "Frames: " << frames << ", passes: " << passes << ", batches: " << batches << ", queries: " << queries
+                  << ", rejected: " << rejected << ", dropped connections: " << dropped;
+        if (passes > 0) { std::cout << ", batches per pass: " << static_cast<double>(batches) / passes; }
+        std::cout << std::endl;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    std::string socketPath = argc > 1 ? argv[1] : protocol::defaultSocketPath;
+    size_t numParticles = argc > 2 ? std::stoul(argv[2]) : 200000;
+    int frameMs = argc > 3 ? std::stoi(argv[3]) : 16;
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << socketPath << std::endl;
+        return 1;
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ::unlink(socketPath.c_str());
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(listener, 64) < 0) {
+        std::perror("quadtree_server");
+        return 1;
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+
+    QueryServer server(numParticles, std::chrono::milliseconds(frameMs));
+    std::cout << "Serving " << numParticles << " particles on " << socketPath << std::endl;
+
+    std::thread simulation(&QueryServer::simulate, &server);
+    std::thread executor(&QueryServer::execute, &server);
+
+    struct Session {
+        std::thread reader, writer;
+        std::shared_ptr<Connection> connection;
+    };
+    std::vector<Session> sessions;
+    while (!stopRequested) {
+        // poll con timeout para revisar periódicamente la señal de parada
+        pollfd listening{listener, POLLIN, 0};
+        int ready = ::poll(&listening, 1, 200);
+
+        // Se liberan los hilos de las conexiones que ya cerraron
+        for (auto it = sessions.begin(); it != sessions.end(); ) {
+            if (it->connection->closed) {
+                it->reader.join();
+                it->writer.join();
+                it = sessions.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (ready <= 0) { continue; }
+
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0) { continue; }
+        auto connection = std::make_shared<Connection>(fd);
+        sessions.push_back(Session{std::thread(&QueryServer::receive, &server, connection),
+                                   std::thread(&QueryServer::transmit, &server, connection), connection});
+    }
+
+    for (auto& session : sessions) {
+        session.connection->shutdown();
+        session.reader.join();
+        session.writer.join();
+    }
+    simulation.join();
+    executor.join();
+    ::close(listener);
+    ::unlink(socketPath.c_str());
+
+    server.printStats();
+    return 0;
+}
@@ -0,0 +1,408 @@
+// Harness de correctitud para tamaños de producción: invariantes estructurales en
+// una sola pasada paralela y resultados de k-NN y rango contra un oráculo de fuerza
+// bruta paralelo. Semillas fijas; se sortean las distribuciones de datos.
+//
+// Uso: quadtree_test [numParticles] [seed]
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include "../QuadTree.h"
+#include "../Parallel.h"
+
+enum class Distribution { Uniform, Clustered, Duplicates, Diagonal };
+
+const char* distributionName(Distribution distribution) {
+    switch (distribution) {
+        case Distribution::Uniform: return "uniform";
+        case Distribution::Clustered: return "clustered";
+        case Distribution::Duplicates: return "duplicates";
+        case Distribution::Diagonal: return "diagonal";
+    }
+    return "";
+}
+
+std::vector<std::shared_ptr<Particle>> generateParticles(Distribution distribution, size_t n, const Rect& boundary, std::mt19937& gen) {
+    float xmin = boundary.getPmin().getX().getValue(), xmax = boundary.getPmax().getX().getValue();
+    float ymin = boundary.getPmin().getY().getValue(), ymax = boundary.getPmax().getY().getValue();
+    std::uniform_real_distribution<float> posDistX(xmin, xmax), posDistY(ymin, ymax);
+    std::uniform_real_distribution<float> velDist(-5.0f, 5.0f);
+
+    // Parámetros sorteados para cada corrida
+    std::vector<Point2D> centers(std::uniform_int_distribution<int>(2, 64)(gen));
+    for (auto& center : centers) { center = Point2D(NType(posDistX(gen)), NType(posDistY(gen))); }
+    std::normal_distribution<float> offsetDist(0.0f, std::uniform_real_distribution<float>(0.1f, 5.0f)(gen));
+    std::uniform_int_distribution<size_t> centerDist(0, centers.size() - 1);
+    std::uniform_real_distribution<float> unitDist(0.0f, 1.0f);
+
+    std::vector<std::shared_ptr<Particle>> particles;
+    particles.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        float x = 0, y = 0;
+        switch (distribution) {
+            case Distribution::Uniform:
+                x = posDistX(gen);
+                y = posDistY(gen);
+                break;
+            case Distribution::Clustered: {
+                const Point2D& center = centers[centerDist(gen)];
+                x = center.getX().getValue() + offsetDist(gen);
+                y = center.getY().getValue() + offsetDist(gen);
+                break;
+            }
+            case Distribution::Duplicates: {
+                const Point2D& center = centers[centerDist(gen)];
+                x = center.getX().getValue();
+                y = center.getY().getValue();
+                break;
+            }
+            case Distribution::Diagonal: {
+                float t = unitDist(gen);
+                x = xmin + t * (xmax - xmin);
+                y = ymin + t * (ymax - ymin);
+                break;
+            }
+        }
+        x = std::min(std::max(x, xmin), xmax);
+        y = std::min(std::max(y, ymin), ymax);
+        particles.push_back(std::make_shared<Particle>(Point2D(x, y), Point2D(NType(velDist(gen)), NType(velDist(gen)))));
+    }
+    return particles;
+}
+
+// Invariantes estructurales
+
+struct StructureStats {
+    size_t nodes = 0;
+    size_t leaves = 0;
+    size_t particles = 0;
+    bool valid = true;
+};
+
+// Verifica un nodo sin descender: hoja/interno, capacidad, límites de hijos,
+// padres, intersecciones entre hermanos y partículas dentro de su hoja.
+bool checkNode(const QuadNode* node) {
+    if (node->isLeaf()) {
+        for (const auto& child : node->getChildren()) {
+            if (child) { return false; }
+        }
+        if (node->getParticles().size() > node->getCapacity() && node->canSubdivide() && !node->isCoincident()) { return false; }
+        for (const auto& particle : node->getParticles()) {
+            if (!node->getBoundary().contains(particle->getPosition())) { return false; }
+        }
+        return true;
+    }
+
+    if (!node->getParticles().empty()) { return false; }
+    for (size_t i = 0; i < 4; ++i) {
+        const auto& child = node->getChild(i);
+        if (!child || child->getParent() != node || !child->getBoundary().isWithin(node->getBoundary())) { return false; }
+        for (size_t j = i + 1; j < 4; ++j) {
+            if (node->getChild(j) && child->getBoundary().intersects(node->getChild(j)->getBoundary())) { return false; }
+        }
+    }
+    return true;
+}
+
+void checkSubtree(const QuadNode* node, StructureStats& stats) {
+    stats.nodes++;
+    if (!checkNode(node)) { stats.valid = false; }
+    if (node->isLeaf()) {
+        stats.leaves++;
+        stats.particles += node->getParticles().size();
+        return;
+    }
+    for (const auto& child : node->getChildren()) {
+        checkSubtree(child.get(), stats);
+    }
+}
+
+// Una sola pasada: la parte superior se expande secuencialmente hasta tener
+// suficientes subárboles, que luego se recorren en paralelo.
+bool verifyStructure(const QuadTree& tree, std::vector<const QuadNode*>& leaves, size_t expectedParticles) {
+    std::vector<const QuadNode*> frontier = {tree.getRoot().get()};
+    StructureStats top;
+    while (frontier.size() < 64 * parallelThreadCount()) {
+        std::vector<const QuadNode*> next;
+        for (const auto& node : frontier) {
+            if (node->isLeaf()) {
+                next.push_back(node);
+                continue;
+            }
+            top.nodes++;
+            if (!checkNode(node)) { top.valid = false; }
+            for (const auto& child : node->getChildren()) { next.push_back(child.get()); }
+        }
+        if (next.size() == frontier.size()) { break; }
+        frontier.swap(next);
+    }
+
+    std::vector<StructureStats> stats(frontier.size());
+    parallelFor(frontier.size(), [&](size_t, size_t i) {
+        checkSubtree(frontier[i], stats[i]);
+    }, 1);
+
+    StructureStats total = top;
+    for (const auto& s : stats) {
+        total.nodes += s.nodes;
+        total.leaves += s.leaves;
+        total.particles += s.particles;
+        total.valid = total.valid && s.valid;
+    }
+
+    leaves.clear();
+    for (const auto& node : frontier) {
+        std::vector<const QuadNode*> stack = {node};
+        while (!stack.empty()) {
+            const QuadNode* current = stack.back();
+            stack.pop_back();
+            if (current->isLeaf()) { leaves.push_back(current); continue; }
+            for (const auto& child : current->getChildren()) { stack.push_back(child.get()); }
+        }
+    }
+
+    if (!total.valid) {
+        std::cout << "Test failed: Structural invariant violated." << std::endl;
+        return false;
+    }
+    if (total.particles != expectedParticles) {
+        std::cout << "Test failed: Tree holds " << total.particles << " particles, expected " << expectedParticles << "." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Cada partícula insertada aparece exactamente una vez en las hojas
+bool verifyAllDataIndexed(const std::vector<const QuadNode*>& leaves, const std::vector<std::shared_ptr<Particle>>& particles) {
+    std::vector<const Particle*> sorted(particles.size());
+    for (size_t i = 0; i < particles.size(); ++i) { sorted[i] = particles[i].get(); }
+    std::sort(sorted.begin(), sorted.end());
+
+    std::vector<std::atomic<uint8_t>> seen(sorted.size());
+    std::atomic<bool> valid(true);
+    parallelFor(leaves.size(), [&](size_t, size_t i) {
+        for (const auto& particle : leaves[i]->getParticles()) {
+            auto it = std::lower_bound(sorted.begin(), sorted.end(), particle.get());
+            if (it == sorted.end() || *it != particle.get() || seen[it - sorted.begin()].exchange(1)) {
+                valid = false;
+            }
+        }
+    });
+
+    if (!valid) {
+        std::cout << "Test failed: Leaves hold unknown or duplicated particles." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Oráculo de fuerza bruta paralelo
+
+std::vector<float> bruteForceKnnDistances(const std::vector<std::shared_ptr<Particle>>& particles, const Point2D& query, size_t k) {
+    const size_t chunk = 1 << 14;
+    size_t numChunks = (particles.size() + chunk - 1) / chunk;
+    std::vector<std::vector<float>> local(numChunks);
+
+    parallelFor(numChunks, [&](size_t, size_t c) {
+        auto& heap = local[c]; // max-heap con las k menores distancias del bloque
+        size_t end = std::min(particles.size(), (c + 1) * chunk);
+        for (size_t i = c * chunk; i < end; ++i) {
+            float distance = query.distance(particles[i]->getPosition()).getValue();
+            if (heap.size() < k) {
+                heap.push_back(distance);
+                std::push_heap(heap.begin(), heap.end());
+            } else if (distance < heap.front()) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.back() = distance;
+                std::push_heap(heap.begin(), heap.end());
+            }
+        }
+    }, 1);
+
+    std::vector<float> distances;
+    for (const auto& heap : local) { distances.insert(distances.end(), heap.begin(), heap.end()); }
+    std::sort(distances.begin(), distances.end());
+    distances.resize(std::min(k, distances.size()));
+    return distances;
+}
+
+std::vector<const Particle*> bruteForceRange(const std::vector<std::shared_ptr<Particle>>& particles, const Rect& range) {
+    const size_t chunk = 1 << 14;
+    size_t numChunks = (particles.size() + chunk - 1) / chunk;
+    std::vector<std::vector<const Particle*>> local(numChunks);
+
+    parallelFor(numChunks, [&](size_t, size_t c) {
+        size_t end = std::min(particles.size(), (c + 1) * chunk);
+        for (size_t i = c * chunk; i < end; ++i) {
+            if (range.contains(particles[i]->getPosition())) { local[c].push_back(particles[i].get()); }
+        }
+    }, 1);
+
+    std::vector<const Particle*> result;
+    for (const auto& part : local) { result.insert(result.end(), part.begin(), part.end()); }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+bool verifyQueries(QuadTree& tree, const std::vector<std::shared_ptr<Particle>>& particles, const Rect& boundary, std::mt19937& gen) {
+    float xmin = boundary.getPmin().getX().getValue(), xmax = boundary.getPmax().getX().getValue();
+    float ymin = boundary.getPmin().getY().getValue(), ymax = boundary.getPmax().getY().getValue();
+    std::uniform_real_distribution<float> posDistX(xmin, xmax), posDistY(ymin, ymax);
+    std::uniform_real_distribution<float> sizeDist(0.0f, 0.1f * (xmax - xmin));
+    std::uniform_int_distribution<size_t> kDist(1, 32);
+
+    for (int i = 0; i < 16; ++i) {
+        Point2D query(NType(posDistX(gen)), NType(posDistY(gen)));
+        size_t k = kDist(gen);
+
+        // Con duplicados hay empates, así que se comparan distancias y no punteros
+        std::vector<float> knnDistances;
+        for (const auto& particle : tree.knn(query, k)) {
+            knnDistances.push_back(query.distance(particle->getPosition()).getValue());
+        }
+        std::sort(knnDistances.begin(), knnDistances.end());
+        if (knnDistances != bruteForceKnnDistances(particles, query, k)) {
+            std::cout << "Test failed: k-NN differs from brute force for query point " << query << " and k = " << k << std::endl;
+            return false;
+        }
+    }
+
+    for (int i = 0; i < 16; ++i) {
+        float x = posDistX(gen), y = posDistY(gen);
+        Rect range(Point2D(x, y), Point2D(x + sizeDist(gen), y + sizeDist(gen)));
+
+        std::vector<const Particle*> rangeResult;
+        for (const auto& particle : tree.rangeQuery(range)) { rangeResult.push_back(particle.get()); }
+        std::sort(rangeResult.begin(), rangeResult.end());
+        if (rangeResult != bruteForceRange(particles, range)) {
+            std::cout << "Test failed: Range query differs from brute force for " << range << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fila del grafo k-NN por fuerza bruta: distancias al cuadrado en float, como knnGraph()
+float squaredDistance(const Point2D& a, const Point2D& b) {
+    float dx = a.getX().getValue() - b.getX().getValue();
+    float dy = a.getY().getValue() - b.getY().getValue();
+    return dx * dx + dy * dy;
+}
+
+std::vector<float> bruteForceGraphRow(const std::vector<std::shared_ptr<Particle>>& particles, size_t id, size_t k) {
+    const size_t chunk = 1 << 14;
+    size_t numChunks = (particles.size() + chunk - 1) / chunk;
+    std::vector<std::vector<float>> local(numChunks);
+    Point2D position = particles[id]->getPosition();
+
+    parallelFor(numChunks, [&](size_t, size_t c) {
+        auto& heap = local[c];
+        size_t end = std::min(particles.size(), (c + 1) * chunk);
+        for (size_t i = c * chunk; i < end; ++i) {
+            if (i == id) { continue; }
+            float distance = squaredDistance(position, particles[i]->getPosition());
+            if (heap.size() < k) {
+                heap.push_back(distance);
+                std::push_heap(heap.begin(), heap.end());
+            } else if (distance < heap.front()) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.back() = distance;
+                std::push_heap(heap.begin(), heap.end());
+            }
+        }
+    }, 1);
+
+    std::vector<float> distances;
+    for (const auto& heap : local) { distances.insert(distances.end(), heap.begin(), heap.end()); }
+    std::sort(distances.begin(), distances.end());
+    distances.resize(std::min(k, distances.size()));
+    return distances;
+}
+
+bool verifyKnnGraph(const QuadTree& tree, size_t expectedParticles, std::mt19937& gen) {
+    size_t k = 8;
+    KnnGraph graph = tree.knnGraph(k);
+    if (graph.particles.size() != expectedParticles || graph.offsets.size() != expectedParticles + 1 ||
+        graph.offsets.back() != graph.neighbors.size()) {
+        std::cout << "Test failed: k-NN graph has an inconsistent CSR layout." << std::endl;
+        return false;
+    }
+
+    std::uniform_int_distribution<size_t> idDist(0, graph.particles.size() - 1);
+    for (int i = 0; i < 16; ++i) {
+        size_t id = idDist(gen);
+        std::vector<float> rowDistances;
+        for (size_t j = graph.offsets[id]; j < graph.offsets[id + 1]; ++j) {
+            rowDistances.push_back(squaredDistance(graph.particles[id]->getPosition(), graph.particles[graph.neighbors[j]]->getPosition()));
+        }
+        if (rowDistances != bruteForceGraphRow(graph.particles, id, k)) {
+            std::cout << "Test failed: k-NN graph row " << id << " differs from brute force." << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Corrida completa sobre una distribución: construcción, un paso de simulación y eliminación
+bool runCase(Distribution distribution, size_t n, unsigned seed) {
+    Rect boundary(Point2D(0, 0), Point2D(1000, 1000));
+    std::mt19937 gen(seed);
+    std::vector<std::shared_ptr<Particle>> particles = generateParticles(distribution, n, boundary, gen);
+    std::vector<const QuadNode*> leaves;
+
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&start]() {
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        start = std::chrono::steady_clock::now();
+        return seconds.count();
+    };
+
+    std::cout << distributionName(distribution) << " (seed " << seed << ", " << n << " particles)" << std::endl;
+    QuadTree tree(boundary);
+    tree.insert(particles);
+    std::cout << "  build: " << elapsed() << " s" << std::endl;
+
+    if (!verifyStructure(tree, leaves, particles.size()) || !verifyAllDataIndexed(leaves, particles)) { return false; }
+    std::cout << "  invariants: " << elapsed() << " s" << std::endl;
+    if (!verifyQueries(tree, particles, boundary, gen)) { return false; }
+    std::cout << "  queries: " << elapsed() << " s" << std::endl;
+    if (!verifyKnnGraph(tree, particles.size(), gen)) { return false; }
+    std::cout << "  k-NN graph: " << elapsed() << " s" << std::endl;
+
+    tree.step(Particle::getTimeStep());
+    if (!verifyStructure(tree, leaves, particles.size()) || !verifyAllDataIndexed(leaves, particles) ||
+        !verifyQueries(tree, particles, boundary, gen)) { return false; }
+    std::cout << "  step + checks: " << elapsed() << " s" << std::endl;
+
+    std::shuffle(particles.begin(), particles.end(), gen);
+    std::vector<std::shared_ptr<Particle>> despawned(particles.begin(), particles.begin() + particles.size() / 10);
+    particles.erase(particles.begin(), particles.begin() + despawned.size());
+    tree.eraseBatch(despawned);
+    if (!verifyStructure(tree, leaves, particles.size()) || !verifyAllDataIndexed(leaves, particles) ||
+        !verifyQueries(tree, particles, boundary, gen)) { return false; }
+    std::cout << "  erase + checks: " << elapsed() << " s" << std::endl;
+
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    size_t numParticles = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(std::stoul(argv[2])) : 2024;
+
+    bool allTestsPassed = true;
+    for (Distribution distribution : {Distribution::Uniform, Distribution::Clustered, Distribution::Duplicates, Distribution::Diagonal}) {
+        if (!runCase(distribution, numParticles, seed++)) {
+            allTestsPassed = false;
+        }
+    }
+
+    if (allTestsPassed) {
+        std::cout << "All tests passed!" << std::endl;
+        return 0;
+    }
+    std::cout << "Some tests failed." << std::endl;
+    return 1;
+}